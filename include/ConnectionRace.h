@@ -0,0 +1,72 @@
+/**
+ * @file ConnectionRace.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of ConnectionRace class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <netdb.h>
+#include <vector>
+
+#define CONNECTION_ATTEMPT_DELAY 250 // Milliseconds after which the next address is tried (RFC 8305)
+
+/**
+ * @brief Races non-blocking connects to all addresses of a server (Happy Eyeballs, RFC 8305), the first established
+ * connection wins and the other attempts are abandoned
+ */
+class ConnectionRace
+{
+  private:
+    int EpollDescriptor;
+    std::vector<const struct addrinfo *> Addresses; // Addresses in the order they are tried
+    std::size_t NextAddress;                        // Index of the address tried next
+    std::vector<int> PendingDescriptors;            // Sockets still connecting
+
+    /**
+     * @brief Start connecting to the next address, addresses refused right away are skipped
+     *
+     * @return Descriptor of the socket if it connected right away, otherwise -1
+     */
+    int StartAttempt();
+    /**
+     * @brief Stop waiting for a connecting socket and close it
+     *
+     * @param descriptor Socket descriptor
+     */
+    void Abandon(int descriptor);
+
+  public:
+    /**
+     * @brief Construct a new race over addresses returned by getaddrinfo
+     *
+     * @param addresses List of addresses
+     */
+    ConnectionRace(const struct addrinfo *addresses);
+    ~ConnectionRace();
+    ConnectionRace(const ConnectionRace &) = delete;
+    ConnectionRace &operator=(const ConnectionRace &) = delete;
+    /**
+     * @brief Order addresses for racing: the first address keeps its place and address families alternate, so an
+     * unreachable family delays the other one by a single attempt delay at most
+     *
+     * @param addresses List of addresses returned by getaddrinfo, already sorted by preference
+     * @return std::vector<const struct addrinfo *> Addresses in the order they are tried
+     */
+    static std::vector<const struct addrinfo *> InterleaveFamilies(const struct addrinfo *addresses);
+    /**
+     * @brief Connect to the first reachable address. The next address is tried whenever the previous attempt fails
+     * or does not finish within the attempt delay, attempts already started keep running
+     *
+     * @param attemptDelay Time after which the next address is tried
+     * @param deadline Time after which connecting is given up
+     * @return Descriptor of the connected non-blocking socket owned by the caller, -1 if no address could be
+     * connected before the deadline
+     */
+    int Connect(std::chrono::milliseconds attemptDelay, std::chrono::steady_clock::time_point deadline);
+};
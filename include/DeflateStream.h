@@ -0,0 +1,70 @@
+/**
+ * @file DeflateStream.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of DeflateStream class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <zlib.h>
+
+#define DEFLATE_CHUNK_SIZE 4096
+
+/**
+ * @brief Compression layer of a connection after COMPRESS DEFLATE (RFC 4978). Both directions are raw deflate
+ * streams, every sent command is flushed, so the server can process it before the next one is sent
+ */
+class DeflateStream
+{
+  private:
+    z_stream Inflater;
+    z_stream Deflater;
+    bool Initialized;
+    bool OutputFull; // Last inflating filled the whole buffer, so more output may be pending
+
+  public:
+    DeflateStream();
+    ~DeflateStream();
+    DeflateStream(const DeflateStream &) = delete;
+    DeflateStream &operator=(const DeflateStream &) = delete;
+    /**
+     * @brief Check if zlib streams of both directions were initialized
+     *
+     */
+    bool IsInitialized() const;
+    /**
+     * @brief Check if received data may be waiting to be inflated, so it can be read without receiving more
+     *
+     */
+    bool HasPending() const;
+    /**
+     * @brief Set compressed received data to be inflated, the data has to stay valid until it is all inflated
+     *
+     * @param data Compressed data
+     * @param length Length of the compressed data
+     */
+    void SetInput(const char *data, std::size_t length);
+    /**
+     * @brief Inflate received data
+     *
+     * @param data Buffer for the inflated data
+     * @param length Size of the buffer
+     * @return long Number of inflated bytes, 0 if more compressed data is needed, -1 if the data is corrupted
+     */
+    long Inflate(char *data, std::size_t length);
+    /**
+     * @brief Deflate data to be sent and flush it, so it can be decompressed by the server right away
+     *
+     * @param data Data to be sent
+     * @param length Length of the data
+     * @param compressed String to which the compressed data is appended
+     * @return False if compressing failed
+     */
+    bool Deflate(const char *data, std::size_t length, std::string &compressed);
+};
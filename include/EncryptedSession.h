@@ -14,7 +14,6 @@
 #include "Utils.h"
 #include <openssl/ssl.h>
 #include <string>
-#include <vector>
 
 class EncryptedSession final : public Session
 {
@@ -23,86 +22,82 @@ class EncryptedSession final : public Session
     SSL *SecureConnection;
     std::string CertificateFile;
     std::string CertificateFileDirectoryPath;
+    std::string SessionCacheFilePath;
+    bool KernelReceive; // TLS records are received by the kernel, so the socket carries decrypted data
+    int SplicePipe[2];  // Pipe through which body literals are spliced to message files, -1 if not created
     /**
-     * @brief Send message to a server
+     * @brief Receive raw data from the server through the SSL connection
      *
-     * @param message Message to be sent
-     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, SOCKET_WRITING if writing to the socket failed
+     * @param data Buffer for the received data
+     * @param length Size of the buffer
+     * @return long Number of received bytes, 0 if the connection was closed, -1 on error with errno set
      */
-    Utils::ReturnCodes SendMessage(const std::string &message);
+    long ReceiveData(char *data, std::size_t length);
+    /**
+     * @brief Send raw data to the server through the SSL connection
+     *
+     * @param data Data to be sent
+     * @param length Number of bytes to be sent
+     * @return long Number of sent bytes, -1 on error
+     */
+    long SendData(const char *data, std::size_t length);
+    /**
+     * @brief Receive the next chunk of a body literal. When the kernel receives TLS records, the chunk is spliced
+     * from the socket to the message file without being copied through userspace, otherwise it is read through the
+     * SSL connection
+     *
+     * @param body Message the literal belongs to
+     * @param length Maximum number of bytes to receive, never past the end of the literal
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, MESSAGE_FILE_WRITE if writing the message failed,
+     * SOCKET_TIMED_OUT if the socket timed out, CONNECTION_CLOSED if the server closed the connection,
+     * SOCKET_READING if reading from the socket failed
+     */
+    Utils::ReturnCodes ReceiveLiteral(StreamedMessage &body, std::size_t length);
+    /**
+     * @brief Check if received data is waiting to be processed, including records already read by OpenSSL
+     *
+     */
+    bool HasPendingData();
     /**
      * @brief Encrypt socket for encrypted communication
      *
-     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, SSL_CONTEXT_CREATE if creating SSL context failed,
-     * CERTIFICATE_ERROR if loading certificates failed, SSL_CONNECTION_ERROR if connection creation failed,
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, the same codes as SecureContextFactory::Acquire if
+     * getting SSL context failed, SSL_CONNECTION_ERROR if connection creation failed,
      * SSL_SET_DESCRIPTOR if setting socket descriptor to the SSL context failed, SSL_HANDSHAKE_FAILED if the SSL
      * handshake failed
      */
     Utils::ReturnCodes EncryptSocket();
     /**
-     * @brief Load certificate directory
-     *
-     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, CERTIFICATE_ERROR if loading certificate directory
-     * failed
-     */
-    Utils::ReturnCodes LoadCertificates();
-    /**
-     * @brief Select mailbox from which to fetch mail.
+     * @brief Offer the TLS session cached for the server and port to the handshake, so it can be resumed
      *
-     * @return IMAPCL_SUCCESS if nothing failed, CANT_ACCESS_MAILBOX if the mailbox can not be accessed,
-     * VALIDITY_FILE_OPEN if the UIDValidity file can not be opened
      */
-    Utils::ReturnCodes SelectMailbox();
+    void LoadCachedSession();
     /**
-     * @brief Search mailbox for mail UIDs
+     * @brief Create an encrypted session with the same server, credentials, mailbox, certificates and options
      *
-     * @param searchKey What messages to be received
-     * @return std::tuple<std::vector<std::string>, Utils::ReturnCodes> Vector containing remote mail UIDs and
-     * IMAPCL_SUCCESS if nothing failed, SOCKET_WRITING if sending a request to the server failed
+     * @return std::unique_ptr<Session> Created session, not connected yet
      */
-    std::tuple<std::vector<std::string>, Utils::ReturnCodes> SearchMailbox(const std::string &searchKey);
+    std::unique_ptr<Session> CreateWorkerSession();
 
   public:
     EncryptedSession(const std::string &serverHostname, const std::string &port, const std::string &username,
                      const std::string &password, const std::string &outDirectoryPath, const std::string &mailBox,
-                     const std::string &certificateFile, const std::string &certificateFileDirectoryPath);
+                     const std::string &certificateFile, const std::string &certificateFileDirectoryPath,
+                     const Utils::SessionOptions &options = Utils::SessionOptions());
     ~EncryptedSession();
     /**
-     * @brief Receive untagged response from a server
+     * @brief Store a TLS session to the cache file of the server and port, called by OpenSSL for every session
+     * (or ticket) received from the server
      *
+     * @param secureConnection SSL connection the session was received on
+     * @param session Received session
+     * @return int 0, the session is not kept referenced
      */
-    Utils::ReturnCodes ReceiveUntaggedResponse();
-    /**
-     * @brief Receive tagged response from a server
-     *
-     */
-    Utils::ReturnCodes ReceiveTaggedResponse();
+    static int StoreSession(SSL *secureConnection, SSL_SESSION *session);
     /**
      * @brief Connect to socket
      *
      * @return IMAPCL_SUCCESS if nothing failed, otherwise SOCKET_CONNECTING
      */
     Utils::ReturnCodes Connect();
-    /**
-     * @brief Authenticate user on the server
-     *
-     * @return IMAPCL_SUCCESS if nothing failed
-     */
-    Utils::ReturnCodes Authenticate();
-    /**
-     * @brief Fetch mail from a mailbox.
-     *
-     * @param headersOnly Fetch only headers
-     * @param newMailOnly Fetch only new mail
-     * @return IMAPCL_SUCCESS if nothing failed, CANT_ACCESS_MAILBOX if the mailbox can not be accessed,
-     * VALIDITY_FILE_OPEN if the UIDValidity file can not be opened
-     */
-    Utils::ReturnCodes FetchMail(const bool headersOnly, const bool newMailOnly);
-    /**
-     * @brief Logout user from session
-     *
-     * @return IMAPCL_SUCCESS if nothing failed, SOCKET_WRITING if writing to a socket failed, INVALID_RESPONSE if
-     * received response from server was invalid
-     */
-    Utils::ReturnCodes Logout();
 };
@@ -0,0 +1,65 @@
+/**
+ * @file FetchQueue.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of FetchQueue class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "UIDSet.h"
+
+typedef enum FetchItem
+{
+    FETCH_SIZE,    // RFC822.SIZE of messages
+    FETCH_HEADERS, // Headers of messages
+    FETCH_BODY     // Full messages
+} FetchItem;
+
+typedef struct FetchCommand
+{
+    UIDSet MessageUIDs;
+    FetchItem Item;
+    std::string Tag;
+    bool Completed;
+} FetchCommand;
+
+/**
+ * @brief Work-stealing queue of FETCH commands shared by connections fetching the same mailbox.
+ * Every connection takes commands from the front of its own queue and, once it runs out of them, steals from the
+ * back of the longest queue of another connection, so a connection stuck on large messages does not hold up the rest
+ * of its share.
+ */
+class FetchQueue
+{
+  private:
+    std::vector<std::deque<FetchCommand>> Queues;
+    std::mutex QueuesMutex;
+    unsigned int NextQueue;
+
+  public:
+    FetchQueue(unsigned int numOfWorkers);
+    ~FetchQueue();
+    /**
+     * @brief Add a command, commands are distributed evenly between the workers
+     *
+     * @param command Command to be added
+     */
+    void Push(const FetchCommand &command);
+    /**
+     * @brief Take a command for a worker
+     *
+     * @param worker Index of the worker
+     * @param command Taken command
+     * @return False if there are no commands left
+     */
+    bool Pop(unsigned int worker, FetchCommand &command);
+};
@@ -29,4 +29,5 @@ class HeaderMessage final : public Message
      *
      */
     void ParseMessageBody();
+    bool IsHeadersOnly() const;
 };
@@ -0,0 +1,49 @@
+/**
+ * @file HostResolver.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of HostResolver class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netdb.h>
+#include <string>
+
+#define RESOLVER_CACHE_TTL 300 // Seconds for which resolved addresses are reused
+
+/**
+ * @brief Process-wide cache of resolved server addresses, shared by all sessions, so connections to the same server
+ * (parallel connections, mailboxes and repeated syncs of a daemon) do not resolve its hostname again
+ */
+class HostResolver
+{
+  private:
+    typedef struct CachedAddresses
+    {
+        std::shared_ptr<struct addrinfo> Addresses;
+        std::chrono::steady_clock::time_point Expiration;
+    } CachedAddresses;
+
+    static std::map<std::string, CachedAddresses> Cache;
+    static std::mutex CacheMutex;
+
+  public:
+    /**
+     * @brief Resolve addresses of a server, failed lookups are not cached
+     *
+     * @param hostname Server hostname
+     * @param port Server port
+     * @param hints Hints passed to getaddrinfo
+     * @return std::shared_ptr<struct addrinfo> Resolved addresses, empty if resolving failed
+     */
+    static std::shared_ptr<struct addrinfo> Resolve(const std::string &hostname, const std::string &port,
+                                                    const struct addrinfo &hints);
+};
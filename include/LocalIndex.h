@@ -0,0 +1,83 @@
+/**
+ * @file LocalIndex.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of LocalIndex class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <string>
+
+#include "UIDSet.h"
+
+#define INDEX_SIGNATURE "imapcl-index 1" // First word of the index file, followed by UIDValidity
+
+/**
+ * @brief Index of messages of a mailbox stored in the output directory, so they are not found by scanning it.
+ * The index file starts with a line holding UIDValidity of the mailbox, every stored message appends a line with
+ * its kind and UID (i.e. 'F 42' for a full message, 'H 42' for headers only). Rewritten index holds ranges of UIDs
+ * (i.e. 'F 1:5000'). Appending a line is a single write, a line torn by a crash is dropped when the index is loaded
+ * and the file is rewritten compacted.
+ */
+class LocalIndex
+{
+  public:
+    typedef enum StoredItem
+    {
+        STORED_HEADERS = 'H', // Only headers of the message are stored
+        STORED_MESSAGE = 'F'  // Full message is stored
+    } StoredItem;
+
+  private:
+    std::string FilePath;
+    int AppendDescriptor; // Descriptor of the index file opened for appending, -1 until the first append
+    UIDSet Messages; // UIDs of stored full messages
+    UIDSet Headers;  // UIDs of messages stored as headers only
+
+    /**
+     * @brief Parse a UID or a range of UIDs of a record (i.e. '42' or '1:5000')
+     *
+     * @param range Record without its kind
+     * @param first First UID of the range
+     * @param last Last UID of the range
+     * @return False if the record is corrupt
+     */
+    static bool ParseRange(const std::string &range, uint32_t &first, uint32_t &last);
+
+  public:
+    LocalIndex(const std::string &filePath);
+    ~LocalIndex();
+    LocalIndex(const LocalIndex &) = delete;
+    LocalIndex &operator=(const LocalIndex &) = delete;
+    /**
+     * @brief Load the index file
+     *
+     * @param validity UIDValidity of the mailbox
+     * @return False if the index file is missing, corrupt or written for another UIDValidity, the index has to be
+     * rebuilt then
+     */
+    bool Load(const std::string &validity);
+    /**
+     * @brief Replace the index file by a new one written to a temporary file and renamed over it
+     *
+     * @param validity UIDValidity of the mailbox
+     * @param messages UIDs of stored full messages
+     * @param headers UIDs of messages stored as headers only
+     * @return False if the index file could not be written
+     */
+    bool Rebuild(const std::string &validity, const UIDSet &messages, const UIDSet &headers);
+    /**
+     * @brief Record a stored message
+     *
+     * @param messageUID UID of the message
+     * @param item What is stored of the message
+     * @return False if the record could not be appended, the message is then fetched again by the next sync
+     */
+    bool Add(uint32_t messageUID, StoredItem item);
+    const UIDSet &GetMessages() const;
+    const UIDSet &GetHeaders() const;
+};
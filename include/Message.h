@@ -11,6 +11,8 @@
 #pragma once
 #include <string>
 
+class MessageStore;
+
 class Message
 {
   protected:
@@ -18,12 +20,18 @@ class Message
     std::string ResponseString;
     std::string FileName;
     std::string MessageBody;
-    int RfcSize;
+    unsigned long RfcSize;
 
   public:
     Message();
-    Message(const std::string &messageUID, const std::string &responseString, int rfcSize);
+    Message(const std::string &messageUID, const std::string &responseString, unsigned long rfcSize);
     virtual ~Message();
+    /**
+     * @brief Set UID of the message, if it was not known when the message was created
+     *
+     * @param messageUID UID of the message
+     */
+    void SetMessageUID(const std::string &messageUID);
     /**
      * @brief Parse the filename from the message body
      *
@@ -37,9 +45,15 @@ class Message
      */
     virtual void ParseMessageBody();
     /**
-     * @brief Dump message body to a local file
+     * @brief Check if only headers of the message were fetched
+     *
+     */
+    virtual bool IsHeadersOnly() const;
+    /**
+     * @brief Write message body to the store
      *
-     * @param outDirectoryPath Path to the output directory
+     * @param store Store of the output directory
+     * @return False if the message could not be written
      */
-    virtual void DumpToFile(const std::string &outDirectoryPath);
+    virtual bool DumpToFile(MessageStore &store);
 };
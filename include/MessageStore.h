@@ -0,0 +1,351 @@
+/**
+ * @file MessageStore.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of MessageStore, MaildirStore, ShardedStore, DedupStore and ArchiveStore classes
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+
+#define ARCHIVE_DIRECTORY "archive"       // Directory of the archive store in the output directory
+#define ARCHIVE_SEGMENT_SIZE 1073741824UL // Bytes of a segment file after which the next one is started
+#define ARCHIVE_PENDING_SIZE 65536        // Bytes of pending index records after which they are flushed
+#define SHARD_FANOUT 256                  // Number of subdirectories of the sharded store
+#define OBJECTS_DIRECTORY "objects"       // Directory of message bodies of the deduplicating store
+
+/**
+ * @brief Layout of messages in the output directory. Messages are written to a temporary file first and delivered
+ * by renaming it, so an interrupted sync never leaves a truncated message behind. The base store keeps messages
+ * directly in the output directory as '<UID>_<Mailbox>_<Hostname>_..._.eml', headers only as '..._h.eml'.
+ */
+class MessageStore
+{
+  protected:
+    std::string OutDirectoryPath;
+
+  public:
+    MessageStore(const std::string &outDirectoryPath);
+    virtual ~MessageStore();
+    /**
+     * @brief Create a store of the given format
+     *
+     * @param format Format of the store
+     * @param outDirectoryPath Path to the output directory
+     */
+    static std::unique_ptr<MessageStore> Create(Utils::StoreFormat format, const std::string &outDirectoryPath);
+    /**
+     * @brief Create directories of the store
+     *
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, otherwise MESSAGE_FILE_WRITE
+     */
+    virtual Utils::ReturnCodes Prepare();
+    /**
+     * @brief Get path of the temporary file a message is written to before it is delivered
+     *
+     * @param name Name unique in the output directory
+     */
+    virtual std::string TemporaryFilePath(const std::string &name) const;
+    /**
+     * @brief Move a completely written temporary file into the store
+     *
+     * @param temporaryFilePath Path to the temporary file
+     * @param fileName File name of the message (i.e. '42_INBOX_imap.example.com_..._.eml')
+     * @param headersOnly Only headers of the message are stored
+     * @return False if the file could not be moved
+     */
+    virtual bool Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool headersOnly);
+    /**
+     * @brief Get the file a message body is written to while it is received from the server. The body is handed
+     * over by DeliverStreamed or given up by Discard
+     *
+     * @param temporaryFilePath Path to the temporary file of the message
+     * @param length Length of the body
+     * @param offset Offset the body starts at in the file
+     * @return Path to the file, the temporary file unless the store writes bodies in place
+     */
+    virtual std::string StreamFilePath(const std::string &temporaryFilePath, unsigned long length,
+                                       unsigned long &offset);
+    /**
+     * @brief Store a message body completely written to the file given by StreamFilePath
+     *
+     * @param filePath Path to the file
+     * @param offset Offset the body starts at in the file
+     * @param length Length of the body
+     * @param fileName File name of the message
+     * @param headersOnly Only headers of the message are stored
+     * @return False if the message could not be stored
+     */
+    virtual bool DeliverStreamed(const std::string &filePath, unsigned long offset, unsigned long length,
+                                 const std::string &fileName, bool headersOnly);
+    /**
+     * @brief Give up a message body written to the file given by StreamFilePath
+     *
+     * @param filePath Path to the file
+     * @param offset Offset the body starts at in the file
+     * @param length Length of the body
+     */
+    virtual void Discard(const std::string &filePath, unsigned long offset, unsigned long length);
+    /**
+     * @brief Store a message held in memory, it is written to a temporary file and delivered
+     *
+     * @param body Body of the message
+     * @param fileName File name of the message
+     * @param headersOnly Only headers of the message are stored
+     * @return False if the message could not be written
+     */
+    virtual bool Write(const std::string &body, const std::string &fileName, bool headersOnly);
+    /**
+     * @brief Remove a stored message
+     *
+     * @param file Path of the stored file as listed by ListMessageFiles
+     */
+    virtual void Remove(const std::filesystem::path &file);
+    /**
+     * @brief Make messages delivered since the last flush findable by ListMessageFiles of other stores
+     *
+     * @return False if the messages could not be recorded
+     */
+    virtual bool Flush();
+    /**
+     * @brief Get paths of all files of stored messages
+     *
+     */
+    virtual std::vector<std::filesystem::path> ListMessageFiles() const;
+    /**
+     * @brief Check by the name of a stored file if it holds only headers of a message, the file is not opened
+     *
+     * @param fileName Name of the stored file
+     */
+    virtual bool IsHeadersOnly(const std::string &fileName) const;
+};
+
+/**
+ * @brief Maildir store: messages are written to 'tmp/' and renamed into 'cur/' with Maildir info holding whether only
+ * headers were fetched (i.e. 'cur/42_INBOX_imap.example.com_..._:2,' for a full message, '...:2,h' for headers only,
+ * 'h' is a keyword flag). Messages moved to 'new/' by other tools are found too.
+ */
+class MaildirStore final : public MessageStore
+{
+  private:
+    /**
+     * @brief Replace characters Maildir readers take for the info separator or a directory (':' and '/') by '_'
+     *
+     * @param name Unique name of a message
+     */
+    static std::string SafeName(std::string name);
+
+  public:
+    MaildirStore(const std::string &outDirectoryPath);
+    ~MaildirStore();
+    Utils::ReturnCodes Prepare();
+    std::string TemporaryFilePath(const std::string &name) const;
+    bool Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool headersOnly);
+    std::vector<std::filesystem::path> ListMessageFiles() const;
+    bool IsHeadersOnly(const std::string &fileName) const;
+};
+
+/**
+ * @brief Sharded store: messages are named the same way as in the flat store, but spread over SHARD_FANOUT
+ * subdirectories '00' to 'ff' by a hash of the file name without its suffix, so headers and the full message of the
+ * same UID land in the same subdirectory. Directories stay small, so creating, looking up and removing a message does
+ * not slow down with hundreds of thousands of messages.
+ */
+class ShardedStore final : public MessageStore
+{
+  public:
+    ShardedStore(const std::string &outDirectoryPath);
+    ~ShardedStore();
+    /**
+     * @brief Get the subdirectory a message belongs to
+     *
+     * @param fileName File name of the message
+     * @return Name of the subdirectory (i.e. '3f')
+     */
+    static std::string ShardOf(const std::string &fileName);
+    Utils::ReturnCodes Prepare();
+    bool Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool headersOnly);
+    std::vector<std::filesystem::path> ListMessageFiles() const;
+};
+
+/**
+ * @brief Deduplicating store: every distinct message body is written once to 'objects/<ab>/<SHA-256 of the body>',
+ * messages are hard links to it named the same way as in the flat store. The same message fetched from several
+ * mailboxes, or accounts sharing the output directory, takes the disk space of one copy and a body already stored is
+ * not written again. An object is removed together with its last message, which finds the object by the digest kept
+ * in an extended attribute of the object.
+ */
+class DedupStore final : public MessageStore
+{
+  private:
+    /**
+     * @brief Get path of the object holding a body
+     *
+     * @param digest Hexadecimal SHA-256 of the body
+     */
+    std::string ObjectFilePath(const std::string &digest) const;
+    /**
+     * @brief Link a message to an object, a message of the same name is replaced
+     *
+     * @param objectFilePath Path to the object
+     * @param fileName File name of the message
+     * @return False if the link could not be created
+     */
+    bool Link(const std::string &objectFilePath, const std::string &fileName) const;
+    /**
+     * @brief Turn a completely written temporary file into the object of its body, unless another store did so
+     * first, and link the message to the object
+     *
+     * @param temporaryFilePath Path to the temporary file, it is removed
+     * @param digest Hexadecimal SHA-256 of the body
+     * @param length Length of the body
+     * @param fileName File name of the message
+     * @return False if the object or the message could not be linked
+     */
+    bool Publish(const std::string &temporaryFilePath, const std::string &digest, unsigned long length,
+                 const std::string &fileName) const;
+
+  public:
+    DedupStore(const std::string &outDirectoryPath);
+    ~DedupStore();
+    /**
+     * @brief Compute SHA-256 of data read from a stream
+     *
+     * @param input Stream of the data
+     * @return Hexadecimal digest, empty if the stream could not be read
+     */
+    static std::string Digest(std::istream &input);
+    Utils::ReturnCodes Prepare();
+    bool Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool headersOnly);
+    bool Write(const std::string &body, const std::string &fileName, bool headersOnly);
+    void Remove(const std::filesystem::path &file);
+};
+
+/**
+ * @brief Archive store: messages are appended one after another to segment files 'archive/segment-000001'. Every store
+ * appends to a segment of its own, claimed by a lock of the segment file that is kept open, and claims the next one
+ * once its segment would grow over its size, so connections and processes may share the archive. Bodies received from
+ * the server are written in place of the segment, without a temporary file. The side index 'archive/index' has a line
+ * per stored message '<UID> <segment> <offset> <length> <F|H> <file name>' and a line '- <file name>' per removed
+ * message, the space of removed messages is not reclaimed. Index records are appended in batches by Flush under a
+ * lock of the index file, a message whose record was not flushed is fetched again.
+ */
+class ArchiveStore final : public MessageStore
+{
+  private:
+    typedef struct ArchivedMessage
+    {
+        std::string FileName;
+        unsigned int Segment;
+        unsigned long Offset;
+        unsigned long Length;
+    } ArchivedMessage;
+
+    unsigned long SegmentBytes;
+    unsigned int CurrentSegment; // Segment claimed by the store, or the highest one seen before it is claimed
+    int SegmentDescriptor;       // Descriptor of the claimed segment, -1 until a segment is claimed
+    unsigned long SegmentEnd;    // Offset after the last message appended to or reserved in the claimed segment
+    int IndexDescriptor;         // Descriptor of the index file, -1 until it is opened
+    std::string PendingRecords;  // Index records of messages stored since the last flush
+
+    /**
+     * @brief Get path of a segment file
+     *
+     * @param segment Number of the segment
+     */
+    std::string SegmentFilePath(unsigned int segment) const;
+    /**
+     * @brief Get number of the segment a file path points to
+     *
+     * @param filePath Path to a file
+     * @return Number of the segment, 0 if the path is not a segment of the archive
+     */
+    unsigned int SegmentOf(const std::string &filePath) const;
+    /**
+     * @brief Lock the index file, so no other store appends records at the same time
+     *
+     * @return False if the index file can not be opened or locked
+     */
+    bool Lock();
+    void Unlock();
+    /**
+     * @brief Make sure the store has claimed a segment with room for a message, a segment is kept locked by the store
+     * that claimed it until it is full
+     *
+     * @param length Length of the message
+     * @return False if no segment can be opened
+     */
+    bool Claim(unsigned long length);
+    /**
+     * @brief Add an index record of a message to the pending records
+     *
+     * @param segment Number of the segment holding the message
+     * @param offset Offset of the message in the segment
+     * @param length Length of the message
+     * @param fileName File name of the message
+     * @param headersOnly Only headers of the message are stored
+     */
+    void Record(unsigned int segment, unsigned long offset, unsigned long length, const std::string &fileName,
+                bool headersOnly);
+    /**
+     * @brief Append a message to the claimed segment and record it
+     *
+     * @param input Stream of the message body
+     * @param fileName File name of the message
+     * @param headersOnly Only headers of the message are stored
+     * @return False if the message could not be appended
+     */
+    bool Append(std::istream &input, const std::string &fileName, bool headersOnly);
+    /**
+     * @brief Read stored messages from the index, removed ones are left out
+     *
+     * @param records Flushed records followed by the pending ones
+     */
+    static std::vector<ArchivedMessage> ParseIndex(const std::string &records);
+    /**
+     * @brief Read flushed and pending index records
+     *
+     */
+    std::string ReadIndex() const;
+
+  public:
+    /**
+     * @brief Construct a new archive store
+     *
+     * @param outDirectoryPath Path to the output directory
+     * @param segmentBytes Bytes of a segment file after which the next one is started
+     */
+    ArchiveStore(const std::string &outDirectoryPath, unsigned long segmentBytes = ARCHIVE_SEGMENT_SIZE);
+    ~ArchiveStore();
+    Utils::ReturnCodes Prepare();
+    bool Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool headersOnly);
+    std::string StreamFilePath(const std::string &temporaryFilePath, unsigned long length, unsigned long &offset);
+    bool DeliverStreamed(const std::string &filePath, unsigned long offset, unsigned long length,
+                         const std::string &fileName, bool headersOnly);
+    void Discard(const std::string &filePath, unsigned long offset, unsigned long length);
+    bool Write(const std::string &body, const std::string &fileName, bool headersOnly);
+    void Remove(const std::filesystem::path &file);
+    bool Flush();
+    std::vector<std::filesystem::path> ListMessageFiles() const;
+    /**
+     * @brief Write archived messages as '.eml' files
+     *
+     * @param names File names of the messages or their beginnings '<UID>', '<UID>_<Mailbox>' or
+     * '<UID>_<Mailbox>_<Hostname>', each has to select a single message (its full message and headers), all messages
+     * are written if it is empty
+     * @param outDirectoryPath Directory the messages are written to
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, ARCHIVE_NOT_FOUND if the archive or a message is
+     * not found, ARCHIVE_AMBIGUOUS_NAME if a name selects messages of several mailboxes, MESSAGE_FILE_WRITE if a
+     * message can not be written
+     */
+    Utils::ReturnCodes Extract(const std::vector<std::string> &names, const std::string &outDirectoryPath) const;
+};
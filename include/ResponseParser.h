@@ -0,0 +1,132 @@
+/**
+ * @file ResponseParser.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of ResponseParser class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Resumable tokenizer of IMAP (RFC 3501) server responses.
+ * Bytes are fed as they arrive from the socket and every byte is inspected exactly once. The parser splits the
+ * stream into line fragments, skips over `{N}` literals and remembers tag and status of the response the fragments
+ * belong to.
+ */
+class ResponseParser
+{
+  public:
+    typedef enum ResponseStatus
+    {
+        STATUS_NONE = 0, // Response without a status (i.e. '* 5 EXISTS')
+        STATUS_OK,       // OK response
+        STATUS_NO,       // NO response
+        STATUS_BAD,      // BAD response
+        STATUS_PREAUTH,  // PREAUTH greeting
+        STATUS_BYE       // BYE response
+    } ResponseStatus;
+
+  private:
+    std::string Line;
+    std::string Tag;
+    ResponseStatus Status;
+    unsigned long LiteralRemaining;
+    unsigned long LiteralSize;
+    bool LineReady;
+    bool ResponseComplete;
+    bool FirstFragment;
+    bool Malformed;
+    /**
+     * @brief Process a fully received line fragment
+     *
+     */
+    void FinishFragment();
+    /**
+     * @brief Start a new line fragment if the previous call finished one
+     *
+     */
+    void StartFeed();
+
+  public:
+    ResponseParser();
+    ~ResponseParser();
+    /**
+     * @brief Reset the parser to the start of a new response
+     *
+     */
+    void Reset();
+    /**
+     * @brief Consume received bytes. Consuming stops after the end of each line fragment and after the end of each
+     * literal, so the caller can react to the boundary before feeding the rest.
+     *
+     * @param data Received bytes
+     * @param length Number of received bytes
+     * @return std::size_t Number of bytes consumed
+     */
+    std::size_t Feed(const char *data, std::size_t length);
+    /**
+     * @brief Consume literal bytes that were received without passing them through the parser (i.e. spliced
+     * directly to a file)
+     *
+     * @param length Number of received literal bytes
+     * @return std::size_t Number of bytes consumed, never more than the rest of the current literal
+     */
+    std::size_t SkipLiteral(std::size_t length);
+    /**
+     * @brief Check if the next fed bytes will be literal data
+     *
+     */
+    bool InLiteral() const;
+    /**
+     * @brief Get number of literal bytes that are yet to be fed
+     *
+     */
+    unsigned long GetLiteralRemaining() const;
+    /**
+     * @brief Get size of the literal announced by the last line fragment, 0 if no literal was announced
+     *
+     */
+    unsigned long GetLiteralSize() const;
+    /**
+     * @brief Check if the last call of Feed finished a line fragment
+     *
+     */
+    bool IsLineReady() const;
+    /**
+     * @brief Get the last finished line fragment without the trailing CRLF
+     *
+     */
+    const std::string &GetLine() const;
+    /**
+     * @brief Check if the last call of Feed finished a whole response
+     *
+     */
+    bool IsResponseComplete() const;
+    /**
+     * @brief Check if the current response is tagged
+     *
+     */
+    bool IsTagged() const;
+    /**
+     * @brief Get tag of the current response ('*' for untagged, '+' for continuation responses)
+     *
+     */
+    const std::string &GetTag() const;
+    /**
+     * @brief Get status of the current response
+     *
+     */
+    ResponseStatus GetStatus() const;
+    /**
+     * @brief Check if a literal whose size does not fit into unsigned long was announced. The rest of the stream can
+     * not be split into responses anymore, the response is kept incomplete until the parser is reset.
+     *
+     */
+    bool IsMalformed() const;
+};
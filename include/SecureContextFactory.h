@@ -0,0 +1,44 @@
+/**
+ * @file SecureContextFactory.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of SecureContextFactory class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <string>
+
+#include "Utils.h"
+
+/**
+ * @brief Process-wide factory of SSL contexts shared by all encrypted sessions. OpenSSL is initialised once and
+ * certificates of every certificate file and directory are loaded once into the certificate store of a single
+ * context, which is handed out to all sessions verifying the server with them
+ */
+class SecureContextFactory
+{
+  private:
+    static std::map<std::string, SSL_CTX *> Contexts; // Contexts by certificate file and directory
+    static std::mutex ContextsMutex;
+    static std::once_flag Initialized;
+
+  public:
+    /**
+     * @brief Get SSL context verifying the server with given certificates, it is created on the first use
+     *
+     * @param certificateFile Certificate file, empty if none
+     * @param certificateFileDirectoryPath Certificate directory
+     * @param secureContext Shared SSL context, its reference has to be released by SSL_CTX_free
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, SSL_CONTEXT_CREATE if creating SSL context failed,
+     * CERTIFICATE_ERROR if loading certificates failed
+     */
+    static Utils::ReturnCodes Acquire(const std::string &certificateFile,
+                                      const std::string &certificateFileDirectoryPath, SSL_CTX *&secureContext);
+};
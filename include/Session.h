@@ -11,87 +11,434 @@
 #pragma once
 
 #include <arpa/inet.h>
+#include <atomic>
+#include <csignal>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <vector>
 
+#include "../include/DeflateStream.h"
+#include "../include/SocketWaiter.h"
+#include "../include/FetchQueue.h"
+#include "../include/HostResolver.h"
+#include "../include/LocalIndex.h"
+#include "../include/MessageStore.h"
+#include "../include/ResponseParser.h"
+#include "../include/StreamedMessage.h"
+#include "../include/UIDSet.h"
 #include "../include/Utils.h"
+
+#define RESUME_CHUNK_SIZE 8388608 // Bytes fetched at once when a download is resumed without --chunk-size
+#define IDLE_RENEW_INTERVAL 1680 // Seconds after which IDLE is re-issued, servers may drop clients idle for 30 minutes
+
 class Session
 {
+  public:
+    typedef struct SyncProgress
+    {
+        std::string MailBox;                            // Mailbox being fetched, empty if no fetch is in progress
+        std::string Validity;                           // UIDVALIDITY of the mailbox
+        unsigned long UidNext;                          // UIDNEXT at the time the remaining UIDs were searched
+        UIDSet RemainingMessageUIDs;                    // UIDs of messages that were to be fetched
+        unsigned int Downloaded;                        // Number of messages stored by the failed connections
+    } SyncProgress;
+
   protected:
     int SocketDescriptor;    // Socket descriptor
-    struct addrinfo *Server; // Structure containing host information
+    SocketWaiter Waiter;     // Waits for readiness of the non-blocking socket
+    std::shared_ptr<struct addrinfo> Server; // Structure containing host information, shared by the resolver cache
     std::string ServerHostname;
     std::string Port;
     std::string Username;
     std::string Password;
     std::string Buffer;
+    std::size_t BufferStart; // Start of received bytes not yet processed by the parser
+    std::size_t BufferEnd;   // End of received bytes in the buffer
     std::string FullResponse;
+    std::string LiteralBuffer; // Buffer for literals read directly from the socket
     std::string OutDirectoryPath;
     std::string MailBox;
+    std::string MailBoxFileName; // Mailbox name used in names of local files
     int CurrentTagNumber;
     Utils::ReturnCodes ReturnCode;
+    ResponseParser Parser;
+    Utils::SessionOptions Options;
+    unsigned int TemporaryFileCounter;                                 // Used for naming bodies without known UID
+    unsigned int WorkerNumber;                                         // Index of the connection fetching the mailbox
+    std::map<uint32_t, unsigned long> MessageSizes;                 // RFC822.SIZE of messages by UID if needed
+    std::map<uint32_t, std::unique_ptr<Message>> ReceivedMessages; // Messages waiting for their command to finish
+    std::vector<std::string> Capabilities;     // Capabilities announced by the server after login, upper case
+    std::unique_ptr<DeflateStream> Compression; // Compression layer after COMPRESS DEFLATE, nullptr if not compressed
+    std::string CompressedBuffer;              // Buffer for compressed data received from the server
+    unsigned long UidNext;                     // Lowest UID a message delivered to the mailbox can get
+    std::string MailBoxValidity;               // UIDVALIDITY of the selected mailbox
+    std::string StoredValidity;                // UIDVALIDITY kept in the validity file, empty if there is none
+    unsigned long long StoredModSeq;           // Modification sequence up to which all mail is local, 0 if unknown
+    unsigned long StoredUidNext;               // UIDNEXT below which all mail is local, 0 if unknown
+    bool StoredHeadersOnly;                    // Mail up to StoredModSeq and StoredUidNext was fetched as headers only
+    unsigned long long HighestModSeq;          // HIGHESTMODSEQ of the selected mailbox, 0 if it is not kept
+    bool QresyncEnabled;                       // QRESYNC was enabled on the connection
+    bool QresyncSelected;                      // Mailbox was selected with QRESYNC, changes came with the response
+    UIDSet ChangedMessageUIDs;                 // UIDs of messages changed since StoredModSeq reported by SELECT
+    std::unique_ptr<StreamedMessage> ChunkedMessage; // Message fetched in chunks, body literals are appended to it
+    std::size_t ChunkLength;                   // Length of the last chunk received for ChunkedMessage
+    bool ChunkArrived;                         // Last chunk of ChunkedMessage came as a literal
+    SyncProgress Progress;                     // Fetch in progress, carried over to the next connection if it fails
+    std::unique_ptr<LocalIndex> Index;         // Index of local mail of the selected mailbox, set by SelectMailbox
+    std::unique_ptr<MessageStore> Store;       // Layout of messages in the output directory
+
+    /**
+     * @brief Get deadline of a socket operation starting now
+     *
+     */
+    std::chrono::steady_clock::time_point OperationDeadline() const;
+    /**
+     * @brief Wait until the socket is ready for reading or writing
+     *
+     * @param write Wait for writing instead of reading
+     * @param deadline Deadline of the operation
+     * @return False with errno set to EAGAIN if the deadline passed, to EIO if waiting failed
+     */
+    bool WaitForSocket(bool write, std::chrono::steady_clock::time_point deadline);
+    /**
+     * @brief Connect a non-blocking socket to the server by racing its addresses, the first established connection
+     * is kept. Connecting is given up after --connect-timeout seconds (--timeout if it is not set)
+     *
+     * @return IMAPCL_SUCCESS if nothing failed, SOCKET_CONNECTING if no address could be connected, SOCKET_CREATING
+     * if the socket can not be watched
+     */
+    Utils::ReturnCodes ConnectSocket();
+    /**
+     * @brief Receive raw data from the server
+     *
+     * @param data Buffer for the received data
+     * @param length Size of the buffer
+     * @return long Number of received bytes, 0 if the connection was closed, -1 on error with errno set (EAGAIN if
+     * the operation timed out)
+     */
+    virtual long ReceiveData(char *data, std::size_t length);
+    /**
+     * @brief Send raw data to the server, all of it is sent unless the operation fails
+     *
+     * @param data Data to be sent
+     * @param length Number of bytes to be sent
+     * @return long Number of sent bytes, -1 on error with errno set (EAGAIN if the operation timed out)
+     */
+    virtual long SendData(const char *data, std::size_t length);
+    /**
+     * @brief Receive data from the server, decompressed if compression is active
+     *
+     * @param data Buffer for the received data
+     * @param length Size of the buffer
+     * @return long Number of received bytes, 0 if the connection was closed, -1 on error with errno set (EAGAIN if
+     * the operation timed out, EIO if the compressed data is corrupted)
+     */
+    long Receive(char *data, std::size_t length);
+    /**
+     * @brief Send data to the server, compressed if compression is active
+     *
+     * @param data Data to be sent
+     * @param length Number of bytes to be sent
+     * @return long Number of sent bytes before compression, -1 on error with errno set
+     */
+    long Send(const char *data, std::size_t length);
+    /**
+     * @brief Request capabilities of the server by the CAPABILITY command
+     *
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, INVALID_RESPONSE if the server refused the
+     * command, otherwise the same codes as SendMessage and ReceiveTaggedResponse
+     */
+    Utils::ReturnCodes RequestCapabilities();
+    /**
+     * @brief Check if the server announced a capability, capabilities are requested if they are not known yet
+     *
+     * @param capability Capability in upper case (i.e. 'COMPRESS=DEFLATE')
+     * @return False if the capability is not supported or requesting capabilities failed
+     */
+    bool HasCapability(const std::string &capability);
+    /**
+     * @brief Compress the connection by COMPRESS DEFLATE if the server supports it and compression is not turned
+     * off. A server refusing the command leaves the connection uncompressed
+     *
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, otherwise the same codes as SendMessage and
+     * ReceiveTaggedResponse
+     */
+    Utils::ReturnCodes EnableCompression();
+    /**
+     * @brief Print how many messages were downloaded from the mailbox
+     *
+     * @param numOfDownloaded Number of downloaded messages
+     * @param newMailOnly Only new mail was fetched
+     * @param headersOnly Only headers were fetched
+     */
+    void PrintSummary(unsigned int numOfDownloaded, const bool newMailOnly, const bool headersOnly);
+    /**
+     * @brief Fetch messages delivered to the selected mailbox since it was fetched, their UIDs are not lower than
+     * UidNext
+     *
+     * @param headersOnly Fetch only headers
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, otherwise the same codes as SearchMailbox and
+     * FetchMessages
+     */
+    Utils::ReturnCodes FetchNewMail(const bool headersOnly);
+    /**
+     * @brief Receive more data into the buffer if all received bytes were already processed
+     *
+     * @return IMAPCL_SUCCESS if nothing failed, SOCKET_TIMED_OUT if the socket timed out, CONNECTION_CLOSED if the
+     * server closed the connection, SOCKET_READING if reading from the socket failed
+     */
+    Utils::ReturnCodes FillBuffer();
+    /**
+     * @brief Check if received data is waiting to be processed, so the next response can be read without waiting
+     * for the socket
+     *
+     */
+    virtual bool HasPendingData();
+    /**
+     * @brief Receive the next complete response of any kind, it is appended to FullResponse
+     *
+     * @return IMAPCL_SUCCESS if nothing failed, otherwise the same codes as FillBuffer
+     */
+    Utils::ReturnCodes ReceiveResponse();
+    /**
+     * @brief Receive the next chunk of a body literal straight into the message, called only when the buffer is
+     * empty, so the chunk is read directly from the connection
+     *
+     * @param body Message the literal belongs to
+     * @param length Maximum number of bytes to receive, never past the end of the literal
+     * @return IMAPCL_SUCCESS if nothing failed, MESSAGE_FILE_WRITE if writing the message failed, otherwise the same
+     * codes as FillBuffer
+     */
+    virtual Utils::ReturnCodes ReceiveLiteral(StreamedMessage &body, std::size_t length);
+    /**
+     * @brief Receive responses to FETCH commands until any tagged response arrives. Bytes of body literals are
+     * written straight to temporary files in bounded chunks instead of being stored in memory. Fetched messages are
+     * stored in ReceivedMessages, fetched sizes in MessageSizes.
+     *
+     * @param completedTag Tag of the received tagged response
+     * @return IMAPCL_SUCCESS if nothing failed, MESSAGE_FILE_WRITE if writing a message failed, otherwise the same
+     * codes as FillBuffer
+     */
+    Utils::ReturnCodes ReceiveFetchResponses(std::string &completedTag);
+    /**
+     * @brief Send FETCH commands, keeping up to PipelineDepth of them in flight at once, and store fetched messages
+     * in the output directory once their command completes
+     *
+     * @param queue Commands to be sent, they are taken from the queue as the window has room for them
+     * @param worker Index of the connection in the queue
+     * @param numOfDownloaded Incremented for every stored message
+     * @return IMAPCL_SUCCESS if nothing failed, INVALID_RESPONSE if a FETCH command failed, otherwise the same codes
+     * as SendMessage and ReceiveFetchResponses
+     */
+    Utils::ReturnCodes RunFetchCommands(FetchQueue &queue, unsigned int worker, unsigned int &numOfDownloaded);
+    /**
+     * @brief Create a session with the same server, credentials, mailbox and options
+     *
+     * @return std::unique_ptr<Session> Created session, not connected yet
+     */
+    virtual std::unique_ptr<Session> CreateWorkerSession();
+    /**
+     * @brief Get path of the temporary file a message body is streamed to
+     *
+     * @param name UID of the message or another name unique in the mailbox
+     */
+    std::string PartialFilePath(const std::string &name) const;
+    /**
+     * @brief Find messages of the selected mailbox whose interrupted download left a partial file, the directory of
+     * partial files is read once instead of looking up a file for every message
+     *
+     * @return UIDSet UIDs of the messages
+     */
+    UIDSet ListPartialUIDs() const;
+    /**
+     * @brief Fetch a message alone in BODY[]<offset.length> chunks appended to its temporary file, which is kept
+     * if the connection fails, so the next run continues after the bytes already stored. The message is complete
+     * once a chunk comes back as a literal shorter than requested and the stored length matches its RFC822.SIZE,
+     * otherwise it stays in the temporary file and is not recorded in the index
+     *
+     * @param uid UID of the message
+     * @param numOfDownloaded Number of downloaded messages, incremented if the message was stored
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, INVALID_RESPONSE if the server refused a chunk,
+     * MESSAGE_FILE_WRITE if the chunk could not be stored, otherwise the same codes as ReceiveFetchResponses
+     */
+    Utils::ReturnCodes FetchMessageInChunks(uint32_t uid, unsigned int &numOfDownloaded);
+    /**
+     * @brief Open an additional connection: resolve the server, connect and authenticate
+     *
+     * @return IMAPCL_SUCCESS if nothing failed, otherwise the same codes as GetHostAddressInfo, Connect and
+     * Authenticate
+     */
+    Utils::ReturnCodes OpenConnection();
+    /**
+     * @brief Set mailbox to be fetched by the next FetchMail
+     *
+     * @param mailBox Mailbox name
+     */
+    void SetMailBox(const std::string &mailBox);
+    /**
+     * @brief List selectable mailboxes on the server
+     *
+     * @param pattern LIST pattern, '*' matches any characters, '%' any characters except the hierarchy delimiter
+     * @return std::tuple<std::vector<std::string>, Utils::ReturnCodes> Vector containing mailbox names and
+     * IMAPCL_SUCCESS if nothing failed, INVALID_RESPONSE if the server refused the command, otherwise the same codes
+     * as SendMessage and ReceiveTaggedResponse
+     */
+    std::tuple<std::vector<std::string>, Utils::ReturnCodes> ListMailboxes(const std::string &pattern);
+    /**
+     * @brief Fetch listed mailboxes one after another until there are none left
+     *
+     * @param mailBoxes Mailboxes to be fetched, shared with the other connections
+     * @param nextMailBox Index of the next mailbox to be fetched, shared with the other connections
+     * @param headersOnly Fetch only headers
+     * @param newMailOnly Fetch only new mail
+     * @return IMAPCL_SUCCESS if nothing failed, otherwise the same codes as FetchMail
+     */
+    Utils::ReturnCodes FetchListedMailboxes(const std::vector<std::string> &mailBoxes,
+                                            std::atomic<std::size_t> &nextMailBox, const bool headersOnly,
+                                            const bool newMailOnly);
+    /**
+     * @brief Fetch messages from the selected mailbox and store them in the output directory. Messages are fetched
+     * in batches of UID sets bounded by BatchCount messages and, if set, BatchBytes bytes (sizes are then fetched up
+     * front). Size of each full message is taken from the length of its body literal. Batches are split between
+     * Connections connections, the additional ones are opened only for the time of fetching. Messages larger than
+     * ChunkBytes (sizes are then fetched up front too) and messages whose interrupted download left a temporary file
+     * are fetched afterwards in chunks by FetchMessageInChunks.
+     *
+     * @param messageUIDs UIDs of messages to be fetched
+     * @param headersOnly Fetch only headers
+     * @param numOfDownloaded Incremented for every stored message
+     * @return IMAPCL_SUCCESS if nothing failed, INVALID_RESPONSE if a FETCH command failed, otherwise the same codes
+     * as SendMessage and ReceiveFetchResponses
+     */
+    Utils::ReturnCodes FetchMessages(const UIDSet &messageUIDs, const bool headersOnly, unsigned int &numOfDownloaded);
+    /**
+     * @brief Get path of the validity file of the selected mailbox
+     *
+     */
+    std::string ValidityFilePath() const;
+    /**
+     * @brief Load the state of the previous sync of the selected mailbox from its validity file. The first line
+     * holds UIDValidity, the optional second line the modification sequence and UIDNEXT up to which all mail was
+     * fetched and whether only headers were fetched (i.e. '917 1204 full', modification sequence is 0 if the server
+     * does not keep them)
+     *
+     * @return IMAPCL_SUCCESS if nothing failed, otherwise VALIDITY_FILE_OPEN
+     */
+    Utils::ReturnCodes LoadSyncState();
+    /**
+     * @brief Store UIDValidity, the highest modification sequence and UIDNEXT of the selected mailbox to its
+     * validity file after all of its mail was fetched
+     *
+     * @param headersOnly Only headers were fetched
+     */
+    void SaveSyncState(const bool headersOnly);
+    /**
+     * @brief Get path of the index file of local mail of the selected mailbox
+     *
+     */
+    std::string IndexFilePath() const;
+    /**
+     * @brief Find local mail of the selected mailbox by scanning the local mail directory
+     *
+     * @return std::tuple<UIDSet, UIDSet> UIDs of stored full messages and of messages stored as headers only
+     */
+    std::tuple<UIDSet, UIDSet> ScanLocalMailDirectory();
+    /**
+     * @brief Load the index of local mail of the selected mailbox, it is rebuilt by scanning the local mail directory
+     * if it is missing, corrupt or belongs to another UIDValidity
+     *
+     */
+    void LoadLocalIndex();
+    /**
+     * @brief Enable QRESYNC (RFC 7162) if the server supports it, so changes of a mailbox are reported when it is
+     * selected
+     *
+     * @return IMAPCL_SUCCESS if nothing failed or the server does not support QRESYNC, otherwise the same codes as
+     * ReceiveTaggedResponse
+     */
+    Utils::ReturnCodes EnableQresync();
     /**
      * @brief Validate UIDValidity of a mailbox.
      * If validity file does not exist, it is created and the UIDValidity is written to it. If it exists and UIDValidity
-     * does not match, MailBoxValidated variable is set to `true`, local mail from current session's server will be
-     * deleted and the remote mailbox will be redownloaded.
+     * does not match, local mail from current session's server will be deleted, the stored modification sequence is
+     * dropped and the remote mailbox will be redownloaded.
      *
      * @return IMAPCL_SUCCESS if nothing failed, otherwise VALIDITY_FILE_OPEN
      */
     virtual Utils::ReturnCodes ValidateMailbox();
     /**
-     * @brief Select mailbox from which to fetch mail.
+     * @brief Select mailbox from which to fetch mail. With validation the mailbox is selected with QRESYNC or
+     * CONDSTORE if the server supports them, so mail changed since the previous sync can be told apart.
      *
+     * @param validateMailbox Check UIDValidity of the mailbox after selecting it
      * @return IMAPCL_SUCCESS if nothing failed, CANT_ACCESS_MAILBOX if the mailbox can not be accessed,
      * VALIDITY_FILE_OPEN if the UIDValidity file can not be opened
      */
-    virtual Utils::ReturnCodes SelectMailbox();
+    virtual Utils::ReturnCodes SelectMailbox(const bool validateMailbox);
     /**
      * @brief Search mailbox for mail UIDs
      *
      * @param searchKey What messages to be received
-     * @return std::tuple<std::vector<std::string>, Utils::ReturnCodes> Vector containing remote mail UIDs and
-     * IMAPCL_SUCCESS if nothing failed, SOCKET_WRITING if sending a request to the server failed
+     * @return std::tuple<UIDSet, Utils::ReturnCodes> Set of remote mail UIDs and IMAPCL_SUCCESS if nothing failed,
+     * SOCKET_WRITING if sending a request to the server failed
+     */
+    virtual std::tuple<UIDSet, Utils::ReturnCodes> SearchMailbox(const std::string &searchKey);
+    /**
+     * @brief Search mailbox for UIDs of mail delivered since a UID was assigned, so the result does not grow with
+     * the size of the mailbox
+     *
+     * @param uid Lowest UID to be found
+     * @return std::tuple<UIDSet, Utils::ReturnCodes> Same as SearchMailbox
      */
-    virtual std::tuple<std::vector<std::string>, Utils::ReturnCodes> SearchMailbox(const std::string &searchKey);
+    std::tuple<UIDSet, Utils::ReturnCodes> SearchMailboxSince(unsigned long uid);
     /**
-     * @brief Search local mail directory for mail with full messages (headers + message body). If mail with headers
-     * only is present, it will be deleted, so full messages can be received. If full messages are found, their
-     * UIDs will be stored, so they can be omitted during fetching of the remote mail
+     * @brief Search local mail index for mail with full messages (headers + message body). If mail with headers
+     * only is present, it will be deleted from the local mail directory, so full messages can be received. If full
+     * messages are found, their UIDs will be stored, so they can be omitted during fetching of the remote mail
      *
-     * @return std::vector<std::string> Contains found UIDs of full messages, so they can be omitted during fetching
+     * @return UIDSet Contains found UIDs of full messages, so they can be omitted during fetching
      */
-    virtual std::vector<std::string> SearchLocalMailDirectoryForFullMail();
+    virtual UIDSet SearchLocalMailDirectoryForFullMail();
     /**
-     * @brief Search local mail directory for all mail (headers only + full messages). If any messages are found,
+     * @brief Search local mail index for all mail (headers only + full messages). If any messages are found,
      * their UIDs will be stored, so they can be omitted during fetching of the remote mail
      *
-     * @return std::vector<std::string> Contains found UIDs of messages, so they can be omitted during fetching
+     * @return UIDSet Contains found UIDs of messages, so they can be omitted during fetching
      */
-    virtual std::vector<std::string> SearchLocalMailDirectoryForAll();
+    virtual UIDSet SearchLocalMailDirectoryForAll();
 
   public:
     Session();
     Session(const std::string &serverHostname, const std::string &port, const std::string &username,
-            const std::string &password, const std::string &outDirectoryPath, const std::string &mailBox);
+            const std::string &password, const std::string &outDirectoryPath, const std::string &mailBox,
+            const Utils::SessionOptions &options = Utils::SessionOptions());
     virtual ~Session();
     /**
-     * @brief Get address info about host
+     * @brief Get the fetch in progress, it is left set if the fetch failed
      *
-     * @return IMAPCL_SUCCESS if nothing failed, otherwise SERVER_BAD_HOST
      */
-    virtual Utils::ReturnCodes GetHostAddressInfo();
+    const SyncProgress &GetProgress() const;
+    /**
+     * @brief Continue a fetch of a failed session. If the same mailbox is fetched with the same UIDValidity, only
+     * its remaining messages and messages delivered since are fetched instead of searching the whole mailbox again
+     *
+     * @param progress Progress of the failed session
+     */
+    void ResumeProgress(const SyncProgress &progress);
     /**
-     * @brief Create communication socket
+     * @brief Get addresses of both families (IPv4 and IPv6) of the host
      *
-     * @return IMAPCL_SUCCESS if nothing failed, otherwise SOCKET_CREATING
+     * @return IMAPCL_SUCCESS if nothing failed, otherwise SERVER_BAD_HOST
      */
-    virtual Utils::ReturnCodes CreateSocket();
+    virtual Utils::ReturnCodes GetHostAddressInfo();
     /**
      * @brief Send message to a server
      *
@@ -116,7 +463,7 @@ class Session
      */
     virtual Utils::ReturnCodes Connect();
     /**
-     * @brief Authenticate user on the server
+     * @brief Authenticate user on the server and compress the connection if the server supports it
      *
      * @return IMAPCL_SUCCESS if nothing failed
      */
@@ -130,6 +477,28 @@ class Session
      * VALIDITY_FILE_OPEN if the UIDValidity file can not be opened
      */
     virtual Utils::ReturnCodes FetchMail(const bool headersOnly, const bool newMailOnly);
+    /**
+     * @brief Fetch mail from all mailboxes matching a LIST pattern. Mailboxes are scheduled over a pool of Connections
+     * connections, each of them fetches one mailbox at a time.
+     *
+     * @param pattern LIST pattern, '*' matches any characters, '%' any characters except the hierarchy delimiter
+     * @param headersOnly Fetch only headers
+     * @param newMailOnly Fetch only new mail
+     * @return IMAPCL_SUCCESS if nothing failed, otherwise the same codes as ListMailboxes and FetchMail
+     */
+    virtual Utils::ReturnCodes FetchMailboxes(const std::string &pattern, const bool headersOnly,
+                                              const bool newMailOnly);
+    /**
+     * @brief Watch the selected mailbox by IDLE and fetch messages as soon as the server announces them. IDLE is
+     * re-issued every IDLE_RENEW_INTERVAL seconds, so the server does not drop the connection
+     *
+     * @param headersOnly Fetch only headers
+     * @param stopped Flag set by a signal handler when watching should stop, it is checked at least every second
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS after watching was stopped, IDLE_NOT_SUPPORTED if the server does not
+     * support IDLE, INVALID_RESPONSE if the server refused IDLE, otherwise the same codes as ReceiveResponse and
+     * FetchNewMail
+     */
+    virtual Utils::ReturnCodes WatchMailbox(const bool headersOnly, const volatile std::sig_atomic_t &stopped);
     /**
      * @brief Logout user from session
      *
@@ -0,0 +1,50 @@
+/**
+ * @file SocketWaiter.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of SocketWaiter class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <chrono>
+
+/**
+ * @brief Blocking wait of a single session for readiness of its non-blocking socket, bounded by a deadline. This is
+ * not an event loop: the session runs its commands synchronously and sessions are run in parallel by threads.
+ */
+class SocketWaiter
+{
+  public:
+    typedef enum WaitResult
+    {
+        WAIT_READY = 0, // Socket is ready
+        WAIT_TIMED_OUT, // Deadline passed before the socket became ready
+        WAIT_FAILED     // Waiting failed
+    } WaitResult;
+
+  private:
+    int WatchedDescriptor;
+
+  public:
+    SocketWaiter();
+    /**
+     * @brief Start watching a socket, the previously watched one is no longer watched
+     *
+     * @param descriptor Socket descriptor
+     * @return False if the descriptor is not valid
+     */
+    bool Watch(int descriptor);
+    /**
+     * @brief Wait until the watched socket is ready for reading or writing
+     *
+     * @param write Wait for writing instead of reading
+     * @param deadline Time after which waiting is given up
+     * @return WaitResult WAIT_READY if the socket is ready (or closed/failed, which the following I/O reports),
+     * WAIT_TIMED_OUT if the deadline passed, WAIT_FAILED if waiting failed
+     */
+    WaitResult Wait(bool write, std::chrono::steady_clock::time_point deadline);
+};
@@ -0,0 +1,59 @@
+/**
+ * @file Statistics.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of Statistics class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <ostream>
+
+/**
+ * @brief Process-wide counters of a run, updated by all sessions and printed with --stats
+ */
+class Statistics
+{
+  public:
+    typedef enum Counter
+    {
+        FULL_HANDSHAKES = 0, // TLS handshakes without session resumption
+        RESUMED_HANDSHAKES,  // TLS handshakes resuming a cached session
+        KERNEL_TLS_RECEIVE,  // Connections with TLS records received by the kernel
+        USERSPACE_TLS,       // Connections requesting kernel TLS that fell back to OpenSSL
+        SPLICED_BYTES,       // Bytes of body literals spliced from the socket to message files
+        COMPRESSED_BYTES,    // Bytes received on compressed connections before decompression
+        DECOMPRESSED_BYTES,  // Bytes received on compressed connections after decompression
+        RECONNECTS,          // Connections reopened after the previous one failed during a sync
+        DEDUPLICATED,        // Messages linked to an already stored copy of their body
+        DEDUPLICATED_BYTES,  // Bytes of bodies of deduplicated messages
+        NUM_OF_COUNTERS
+    } Counter;
+
+  private:
+    static std::atomic<unsigned long> Counters[NUM_OF_COUNTERS];
+
+  public:
+    /**
+     * @brief Add to a counter
+     *
+     * @param counter Counter to be increased
+     * @param value Value added to the counter
+     */
+    static void Add(Counter counter, unsigned long value = 1);
+    /**
+     * @brief Get value of a counter
+     *
+     */
+    static unsigned long Get(Counter counter);
+    /**
+     * @brief Print counters of the run, counters of features not used in the run are left out
+     *
+     * @param stream Stream to print to
+     */
+    static void Print(std::ostream &stream);
+};
@@ -0,0 +1,109 @@
+/**
+ * @file StreamedMessage.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of StreamedMessage class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include "Message.h"
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+#define HEADER_SCAN_LIMIT 65536
+
+/**
+ * @brief Message whose body is written to a file while it is being received, so it never has to be held in memory as
+ * a whole. The file is a temporary file, or a file of the store the body is written in place of
+ *
+ */
+class StreamedMessage final : public Message
+{
+  private:
+    std::string FilePath;
+    std::ofstream File;
+    unsigned long StartOffset; // Offset the body starts at in the file
+    MessageStore *Store;       // Store the body is written in place of, nullptr for a temporary file of the message
+    int SpliceDescriptor;      // Descriptor of the file for splicing, -1 until the first splice
+    bool Resumable;            // Temporary file is kept if the message is not completed, so its download can be resumed
+    /**
+     * @brief Load headers of the message from the file into the response string
+     *
+     */
+    void LoadHeaders();
+
+  public:
+    /**
+     * @brief Construct a new message streamed to the file the store gives for it
+     *
+     * @param messageUID UID of the message, empty if it is not known yet
+     * @param store Store of the output directory
+     * @param temporaryFilePath Path to the temporary file used unless the store writes the body in place
+     * @param rfcSize Size of the message
+     */
+    StreamedMessage(const std::string &messageUID, MessageStore &store, const std::string &temporaryFilePath,
+                    unsigned long rfcSize);
+    /**
+     * @brief Construct a new message streamed to a temporary file
+     *
+     * @param messageUID UID of the message, empty if it is not known yet
+     * @param temporaryFilePath Path to the temporary file
+     * @param rfcSize Size of the message
+     * @param resumable Append to the temporary file left by an interrupted download and keep it if this one is
+     * interrupted too
+     */
+    StreamedMessage(const std::string &messageUID, const std::string &temporaryFilePath, unsigned long rfcSize,
+                    bool resumable = false);
+    ~StreamedMessage();
+    /**
+     * @brief Get number of bytes of the message stored in the file
+     *
+     */
+    std::size_t GetStoredLength();
+    /**
+     * @brief Make received parts of the message durable in the file
+     *
+     * @return False if writing to the file failed
+     */
+    bool Flush();
+    /**
+     * @brief Append part of the message body to the file
+     *
+     * @param data Part of the message body
+     * @param length Length of the part
+     * @return False if writing to the file failed
+     */
+    bool Write(const char *data, std::size_t length);
+    /**
+     * @brief Append part of the message body waiting in a pipe to the file without copying it through userspace
+     *
+     * @param pipeDescriptor Read end of the pipe
+     * @param length Number of bytes waiting in the pipe
+     * @return False if moving the data to the file failed
+     */
+    bool Splice(int pipeDescriptor, std::size_t length);
+    /**
+     * @brief Parse the filename from the message headers stored in the file
+     *
+     * @param serverHostname Remote server hostname
+     * @param mailbox Remote mailbox from which the mail was fetched
+     */
+    void ParseFileName(const std::string &serverHostname, const std::string &mailbox);
+    /**
+     * @brief Message body is already stored in the file, nothing to parse
+     *
+     */
+    void ParseMessageBody();
+    /**
+     * @brief Deliver the message body to the store
+     *
+     * @param store Store of the output directory
+     * @return False if the message could not be stored
+     */
+    bool DumpToFile(MessageStore &store);
+};
@@ -0,0 +1,109 @@
+/**
+ * @file SyncDaemon.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of SyncDaemon class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Session.h"
+#include "Utils.h"
+
+#define RECONNECT_BASE_DELAY 1U // Seconds before the first reconnect, the delay doubles with every failed connection
+#define RECONNECT_MAX_DELAY 60U // Maximum seconds between reconnects
+
+/**
+ * @brief Long-running sync of many accounts. Accounts are read from a config file, one account per line written
+ * the same way as command line arguments of a single sync. A bounded number of worker threads syncs accounts when
+ * they are due, every account is synced again after the sync interval with a random jitter. SSL contexts with
+ * loaded certificates (see SecureContextFactory) and resolved server addresses are shared by all syncs.
+ */
+class SyncDaemon
+{
+  private:
+    typedef struct ScheduledSync
+    {
+        std::chrono::steady_clock::time_point Time;
+        std::size_t Account; // Index of the account in Accounts
+    } ScheduledSync;
+
+    std::string ConfigFilePath;
+    unsigned int SyncInterval;
+    unsigned int SyncJitter;
+    unsigned int Workers;
+    std::vector<Utils::Arguments> Accounts;
+    std::vector<ScheduledSync> Schedule; // Heap of upcoming syncs, the earliest one first
+    std::mutex ScheduleMutex;
+    std::condition_variable ScheduleChanged;
+    std::mt19937 Random;
+    static volatile std::sig_atomic_t Stopped;
+
+    /**
+     * @brief Stop the daemon after the running syncs finish
+     *
+     * @param signal Received signal
+     */
+    static void Stop(int signal);
+    /**
+     * @brief Get time of the next sync of an account
+     *
+     * @param maximumDelay Maximum delay in seconds from now
+     * @param minimumDelay Minimum delay in seconds from now
+     */
+    std::chrono::steady_clock::time_point ScheduleTime(unsigned int maximumDelay, unsigned int minimumDelay);
+    /**
+     * @brief Sync accounts when they are due until the daemon is stopped
+     *
+     */
+    void RunWorker();
+    /**
+     * @brief Run a single connection of a sync: connect, authenticate, fetch mail, watch the mailbox if requested
+     * and logout
+     *
+     * @param account Arguments of the account
+     * @param session Session of the connection
+     * @param authenticated Set to true once the session is authenticated
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, otherwise the code of the failed step
+     */
+    static Utils::ReturnCodes RunSession(const Utils::Arguments &account, Session &session, bool &authenticated);
+
+  public:
+    SyncDaemon(const Utils::Arguments &arguments);
+    /**
+     * @brief Read accounts from the config file. Empty lines and lines starting with '#' are skipped.
+     *
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, CONFIG_FILE_OPEN if the config file can not be
+     * opened, CONFIG_INVALID_ACCOUNT if arguments of an account are invalid, otherwise the same codes as
+     * SecureContextFactory::Acquire
+     */
+    Utils::ReturnCodes LoadConfig();
+    /**
+     * @brief Sync accounts periodically until SIGINT or SIGTERM is received
+     *
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS after the daemon is stopped
+     */
+    Utils::ReturnCodes Run();
+    /**
+     * @brief Sync a single account: connect, authenticate, fetch mail and logout. With --idle the mailbox is watched
+     * for new mail until SIGINT or SIGTERM is received before logging out. If the connection fails, the sync
+     * reconnects up to --reconnects times in a row with exponentially growing delays and continues with the
+     * messages that remained, the number of reconnects is printed at the end. The sync is not retried if the first
+     * connection fails before it is authenticated
+     *
+     * @param account Arguments of the account
+     * @return Utils::ReturnCodes IMAPCL_SUCCESS if nothing failed, otherwise the code of the last failed step
+     */
+    static Utils::ReturnCodes SyncAccount(const Utils::Arguments &account);
+};
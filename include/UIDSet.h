@@ -0,0 +1,114 @@
+/**
+ * @file UIDSet.h
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains declaration of UIDSet class
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Set of message UIDs stored as sorted, disjoint intervals of consecutive UIDs. Mailboxes are mostly made of
+ * long runs of UIDs, so a set of a million UIDs usually takes a few intervals, and union and difference of two sets
+ * take time linear in the number of their intervals.
+ */
+class UIDSet
+{
+  public:
+    typedef struct Interval
+    {
+        uint32_t First;
+        uint32_t Last;
+    } Interval;
+
+  private:
+    std::vector<Interval> Intervals; // Sorted, neither overlapping nor adjacent
+
+    /**
+     * @brief Append an interval not lower than the last one, it is merged with the last one if they touch
+     *
+     * @param first First UID of the interval
+     * @param last Last UID of the interval
+     */
+    void Append(uint32_t first, uint32_t last);
+
+  public:
+    UIDSet();
+    /**
+     * @brief Construct a set of UIDs given in any order, duplicates are allowed
+     *
+     * @param uids UIDs of messages
+     */
+    UIDSet(std::vector<uint32_t> uids);
+    /**
+     * @brief Construct a set of UIDs given as decimal strings (i.e. found by SEARCH), invalid ones are skipped
+     *
+     * @param messageUIDs UIDs of messages
+     */
+    UIDSet(const std::vector<std::string> &messageUIDs);
+    /**
+     * @brief Parse a UID written in decimal
+     *
+     * @param text Written UID, at most 10 digits
+     * @param uid Parsed UID
+     * @return False if the text is not a number or does not fit into a UID
+     */
+    static bool ParseUID(const std::string &text, uint32_t &uid);
+    /**
+     * @brief Add UIDs, adding UIDs higher than the highest one of the set takes constant time
+     *
+     * @param first First UID to be added
+     * @param last Last UID to be added
+     */
+    void Insert(uint32_t first, uint32_t last);
+    void Insert(uint32_t uid);
+    /**
+     * @brief Remove a UID
+     *
+     * @param uid UID to be removed
+     */
+    void Erase(uint32_t uid);
+    /**
+     * @brief Check if the set contains a UID, takes logarithmic time in the number of intervals
+     *
+     * @param uid Checked UID
+     */
+    bool Contains(uint32_t uid) const;
+    /**
+     * @brief Get UIDs contained in either of the sets
+     *
+     * @param other Other set
+     */
+    UIDSet Union(const UIDSet &other) const;
+    /**
+     * @brief Get UIDs of this set not contained in the other set (i.e. remote mail missing locally)
+     *
+     * @param other Other set
+     */
+    UIDSet Difference(const UIDSet &other) const;
+    /**
+     * @brief Get number of UIDs in the set
+     *
+     */
+    std::size_t Size() const;
+    bool Empty() const;
+    /**
+     * @brief Get the highest UID of the set, 0 if the set is empty
+     *
+     */
+    uint32_t Highest() const;
+    /**
+     * @brief Get the set written as an IMAP sequence set (i.e. '1:3,5,7:8')
+     *
+     */
+    std::string ToSequenceSet() const;
+    const std::vector<Interval> &GetIntervals() const;
+    bool operator==(const UIDSet &other) const;
+};
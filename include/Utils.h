@@ -10,18 +10,29 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <regex>
+#include <sstream>
 #include <string>
+#include <strings.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <vector>
 
 #define BUFFER_SIZE 2048
+#define LITERAL_CHUNK_SIZE 65536
+#define MAX_SEQUENCE_SET_LENGTH 4096
+#define MAX_TIMEOUT 86400 // Highest --timeout and --connect-timeout in seconds
 
 namespace Utils
 {
@@ -52,9 +63,71 @@ typedef enum ReturnCodes
     SSL_CONTEXT_CREATE,       // Failed creating SSL context
     SSL_CONNECTION_CREATE,    // Failed creating SSL connection
     SSL_SET_DESCRIPTOR,       // Failed setting socket descriptor to the SSL context
-    SSL_HANDSHAKE_FAILED      // Failed the SSL handshake
+    SSL_HANDSHAKE_FAILED,     // Failed the SSL handshake
+    SOCKET_READING,           // Failed reading from a socket
+    CONNECTION_CLOSED,        // Connection closed by the server
+    MESSAGE_FILE_WRITE,       // Failed writing a message file
+    ARGS_INVALID_VALUE,       // Invalid value of an argument option
+    CONFIG_FILE_OPEN,         // Failed opening daemon config file
+    CONFIG_INVALID_ACCOUNT,   // Invalid account in daemon config file
+    IDLE_NOT_SUPPORTED,       // Server does not support IDLE
+    ARCHIVE_NOT_FOUND,        // Archive or a message to be extracted from it not found
+    ARCHIVE_AMBIGUOUS_NAME    // Name of a message to be extracted matches messages of several mailboxes
 } ReturnCodes;
 
+typedef enum LongOptions
+{
+    OPTION_PIPELINE = 256, // --pipeline
+    OPTION_BATCH_COUNT,    // --batch-count
+    OPTION_BATCH_SIZE,     // --batch-size
+    OPTION_CONNECTIONS,    // --connections
+    OPTION_MAILBOXES,      // --mailboxes
+    OPTION_DAEMON,         // --daemon
+    OPTION_INTERVAL,       // --interval
+    OPTION_JITTER,         // --jitter
+    OPTION_WORKERS,        // --workers
+    OPTION_TIMEOUT,        // --timeout
+    OPTION_TLS_CACHE,      // --tls-cache
+    OPTION_STATS,          // --stats
+    OPTION_KTLS,           // --ktls
+    OPTION_NO_COMPRESS,    // --no-compress
+    OPTION_IDLE,           // --idle
+    OPTION_CONNECT_TIMEOUT, // --connect-timeout
+    OPTION_CHUNK_SIZE,     // --chunk-size
+    OPTION_RECONNECTS,     // --reconnects
+    OPTION_STORE,          // --store
+    OPTION_EXTRACT         // --extract
+} LongOptions;
+
+typedef enum StoreFormat
+{
+    STORE_FLAT,    // Messages directly in the output directory
+    STORE_MAILDIR, // Maildir with tmp/, new/ and cur/ subdirectories
+    STORE_SHARDED, // Messages spread over subdirectories by a hash of their file names
+    STORE_DEDUP,   // Messages hard linked to bodies stored once under their SHA-256
+    STORE_ARCHIVE  // Messages appended to segment files with a side index
+} StoreFormat;
+
+typedef struct SessionOptions
+{
+    unsigned int PipelineDepth;  // Maximum number of FETCH commands in flight
+    unsigned int BatchCount;     // Maximum number of messages fetched by one FETCH command
+    unsigned int BatchBytes;     // Maximum total size of messages fetched by one FETCH command, 0 if unbounded
+    unsigned int Connections;    // Number of connections fetching messages of the mailbox in parallel
+    unsigned int Timeout;        // Seconds a single socket operation may wait for the server
+    unsigned int ConnectTimeout; // Seconds connecting to the server may take, 0 if Timeout is used
+    unsigned int ChunkBytes;     // Messages larger than this are fetched in resumable chunks of it, 0 if disabled
+    unsigned int Reconnects;     // Reconnects in a row after the connection fails before the sync is given up
+    std::string TlsCachePath;    // Directory of cached TLS sessions, empty if the output directory is used
+    bool KernelTls;              // Offload TLS records to the kernel and splice body literals to message files
+    bool Compress;               // Compress connections by COMPRESS DEFLATE if the server supports it
+    StoreFormat Store;           // Layout of messages in the output directory
+
+    SessionOptions()
+        : PipelineDepth(1), BatchCount(100), BatchBytes(0), Connections(1), Timeout(10), ConnectTimeout(0),
+          ChunkBytes(0), Reconnects(5), TlsCachePath(""), KernelTls(false), Compress(true), Store(STORE_FLAT) {};
+} SessionOptions;
+
 typedef struct Arguments
 {
     std::string ServerAddress;
@@ -66,14 +139,26 @@ typedef struct Arguments
     bool OnlyMailHeaders;
     std::string AuthFilePath;
     std::string MailBox;
+    std::string MailBoxPattern;
     std::string OutDirectoryPath;
     std::string Username;
     std::string Password;
+    SessionOptions Options;
+    std::string ConfigFilePath; // Daemon config file, empty if not running as a daemon
+    unsigned int SyncInterval;  // Seconds between syncs of an account in daemon mode
+    unsigned int SyncJitter;    // Maximum random delay in seconds added to the sync interval
+    unsigned int Workers;       // Number of accounts synced at once in daemon mode
+    bool PrintStatistics;       // Print counters of the run to standard output when it ends
+    bool Idle;                  // Keep watching the mailbox by IDLE after it is fetched
+    std::string ExtractPath;    // Output directory holding an archive to extract messages from, empty if syncing
+    std::vector<std::string> ExtractNames; // File names or UIDs of messages to be extracted, all if empty
 
     Arguments()
         : Port("143"), Encrypted(false), CertificateFile(""), CertificateFileDirectoryPath("/etc/ssl/certs/"),
-          OnlyNewMails(false), OnlyMailHeaders(false), AuthFilePath(""), MailBox("INBOX"), OutDirectoryPath(""),
-          Username(""), Password("") {};
+          OnlyNewMails(false), OnlyMailHeaders(false), AuthFilePath(""), MailBox("INBOX"), MailBoxPattern(""),
+          OutDirectoryPath(""),
+          Username(""), Password(""), ConfigFilePath(""), SyncInterval(300), SyncJitter(30), Workers(4),
+          PrintStatistics(false), Idle(false), ExtractPath("") {};
 } Arguments;
 
 /**
@@ -92,18 +177,334 @@ inline Utils::ReturnCodes PrintError(ReturnCodes returnCode, const std::string &
 }
 
 /**
- * @brief Validate response recieved from the IMAP server
+ * @brief Parse the value of a numeric argument option
+ *
+ * @param value Argument option
+ * @param name Name of the value used in the error message (i.e. "Pipeline depth")
+ * @param minimum Lowest accepted number
+ * @param maximum Highest accepted number
+ * @param number Parsed number
+ * @return IMAPCL_SUCCESS if nothing failed, ARGS_MISSING_OPTION if the value is another option, otherwise
+ * ARGS_INVALID_VALUE
+ */
+inline ReturnCodes ParseNumericOption(const char *value, const std::string &name, unsigned long minimum,
+                                      unsigned long maximum, unsigned int &number)
+{
+    if (value[0] == '-' && !std::isdigit(static_cast<unsigned char>(value[1])))
+        return PrintError(Utils::ARGS_MISSING_OPTION, "Missing required argument option");
+    char *end;
+    errno = 0;
+    unsigned long parsed = std::strtoul(value, &end, 10);
+    if (errno || *end != '\0' || end == value || value[0] == '-' || parsed < minimum || parsed > maximum)
+        return PrintError(Utils::ARGS_INVALID_VALUE,
+                          name + (minimum > 0 ? " has to be a positive number" : " has to be a number") +
+                              (maximum < UINT32_MAX ? " up to " + std::to_string(maximum) : ""));
+    number = parsed;
+    return Utils::IMAPCL_SUCCESS;
+}
+
+/**
+ * @brief Find a numeric FETCH data item (i.e. 'UID 42' or 'RFC822.SIZE 1024') in a line of a FETCH response
  *
- * @param response Response from the server
- * @param expressionString String containing validation expression
+ * @param line Line of a FETCH response
+ * @param item Name of the data item
+ * @return std::string Value of the data item, empty if the item is not present
+ */
+inline std::string ExtractFetchItem(const std::string &line, const std::string &item)
+{
+    for (std::size_t start = 0; start + item.length() < line.length(); start++)
+    {
+        // Data item names start after a space or the opening parenthesis of the FETCH response
+        if (start > 0 && line[start - 1] != ' ' && line[start - 1] != '(')
+            continue;
+        if (strncasecmp(line.c_str() + start, item.c_str(), item.length()) || line[start + item.length()] != ' ')
+            continue;
+        std::size_t valueStart = start + item.length() + 1;
+        std::size_t valueEnd = valueStart;
+        while (valueEnd < line.length() && std::isdigit(static_cast<unsigned char>(line[valueEnd])))
+            valueEnd++;
+        if (valueEnd > valueStart)
+            return line.substr(valueStart, valueEnd - valueStart);
+    }
+    return "";
+}
+
+/**
+ * @brief Get name of the FETCH data item whose value is the literal announced at the end of a line
+ * (i.e. 'BODY[]' for '* 1 FETCH (UID 42 BODY[] {1024}')
  *
- * @return False if response is valid
+ * @param line Line of a FETCH response ending with a literal
+ * @return std::string Name of the data item, empty if there is none
  */
-inline bool ValidateResponse(const std::string &response, const std::string &expressionString)
+inline std::string ExtractLiteralItem(const std::string &line)
 {
-    std::regex expression(expressionString, std::regex_constants::icase);
-    std::smatch match;
-    return (!std::regex_search(response, match, expression));
+    std::size_t literalStart = line.rfind(" {");
+    if (literalStart == std::string::npos)
+        return "";
+    std::size_t itemStart = line.rfind(' ', literalStart - 1);
+    itemStart = (itemStart == std::string::npos) ? 0 : itemStart + 1;
+    if (line[itemStart] == '(')
+        itemStart++;
+    return line.substr(itemStart, literalStart - itemStart);
+}
+
+/**
+ * @brief Get length of a range of UIDs written in an IMAP sequence set with its separator (i.e. '1:500,')
+ *
+ * @param first First UID of the range
+ * @param last Last UID of the range
+ * @return std::size_t Length of the range
+ */
+inline std::size_t SequenceRangeLength(uint32_t first, uint32_t last)
+{
+    std::size_t length = std::to_string(first).length() + 1;
+    if (last != first)
+        length += std::to_string(last).length() + 1;
+    return length;
+}
+
+/**
+ * @brief Quote a string (i.e. a mailbox name) to be sent to the server as an IMAP quoted string
+ *
+ * @param value String to be quoted
+ * @return std::string Quoted string
+ */
+inline std::string QuoteString(const std::string &value)
+{
+    std::string quoted = "\"";
+    for (char character : value)
+    {
+        if (character == '"' || character == '\\')
+            quoted += '\\';
+        quoted += character;
+    }
+    return quoted + "\"";
+}
+
+/**
+ * @brief Get a form of a mailbox name usable in names of local files. Hierarchy delimiters and characters other
+ * than letters, digits, '.', '-', '&', '+' and ',' (used by modified UTF-7) are replaced by '_'
+ *
+ * @param mailBox Mailbox name
+ * @return std::string Mailbox name usable in file names
+ */
+inline std::string MailboxFileName(const std::string &mailBox)
+{
+    std::string fileName = mailBox;
+    for (auto &character : fileName)
+        if (!std::isalnum(static_cast<unsigned char>(character)) && character != '.' && character != '-' &&
+            character != '&' && character != '+' && character != ',')
+            character = '_';
+    return fileName;
+}
+
+/**
+ * @brief Get UID of a locally stored message from its file name ('<UID>_<mailbox>_<server>_...')
+ *
+ * @param fileName Name of the file without its directory
+ * @param mailBox Mailbox name in the form used in file names
+ * @param serverHostname Server hostname
+ * @return std::string UID of the message, empty if the file is not a message of the mailbox on the server
+ */
+inline std::string ExtractLocalMessageUID(const std::string &fileName, const std::string &mailBox,
+                                          const std::string &serverHostname)
+{
+    std::size_t uidEnd = 0;
+    while (uidEnd < fileName.length() && std::isdigit(static_cast<unsigned char>(fileName[uidEnd])))
+        uidEnd++;
+    std::string infix = "_" + mailBox + "_" + serverHostname + "_";
+    if (uidEnd == 0 || fileName.compare(uidEnd, infix.length(), infix))
+        return "";
+    return fileName.substr(0, uidEnd);
+}
+
+/**
+ * @brief Get names of selectable mailboxes from untagged LIST responses
+ * (i.e. '* LIST (\\HasNoChildren) "/" "Sent Items"')
+ *
+ * @param response Full response to the LIST command
+ * @return std::vector<std::string> Mailbox names in the order they were listed
+ */
+inline std::vector<std::string> ParseListResponse(const std::string &response)
+{
+    std::vector<std::string> mailBoxes;
+    std::size_t lineStart = 0;
+    while (lineStart < response.length())
+    {
+        std::size_t lineEnd = response.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = response.length();
+        std::string line = response.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (strncasecmp(line.c_str(), "* LIST (", 8))
+            continue;
+        // Mailbox attributes
+        std::size_t position = line.find(')', 8);
+        if (position == std::string::npos)
+            continue;
+        std::string attributes = line.substr(8, position - 8);
+        std::transform(attributes.begin(), attributes.end(), attributes.begin(), ::tolower);
+        bool selectable =
+            attributes.find("\\noselect") == std::string::npos && attributes.find("\\nonexistent") == std::string::npos;
+        // Hierarchy delimiter, either NIL or a quoted character
+        position += 2;
+        if (position < line.length() && line[position] == '"')
+        {
+            position = line.find('"', position + (line[position + 1] == '\\' ? 3 : 2));
+            if (position == std::string::npos)
+                continue;
+            position++;
+        }
+        else
+            position = line.find(' ', position);
+        if (position == std::string::npos || position + 1 >= line.length())
+            continue;
+        position++;
+        // Mailbox name, either a quoted string, a literal or an atom
+        std::string mailBox = "";
+        if (line[position] == '"')
+        {
+            for (position++; position < line.length() && line[position] != '"'; position++)
+            {
+                if (line[position] == '\\' && position + 1 < line.length())
+                    position++;
+                mailBox += line[position];
+            }
+        }
+        else if (line[position] == '{' && line.back() == '}')
+        {
+            unsigned long literalSize = std::strtoul(line.c_str() + position + 1, nullptr, 10);
+            mailBox = response.substr(lineStart, literalSize);
+            // Skipping the literal and the rest of the line after it
+            lineEnd = response.find('\n', lineStart + literalSize);
+            lineStart = (lineEnd == std::string::npos) ? response.length() : lineEnd + 1;
+        }
+        else
+            mailBox = line.substr(position);
+        if (selectable && !mailBox.empty())
+            mailBoxes.push_back(mailBox);
+    }
+    return mailBoxes;
+}
+
+/**
+ * @brief Split a line into arguments separated by whitespace, double quotes group whitespace into an argument
+ * (i.e. 'imap.server -a "auth file.txt"')
+ *
+ * @param line Line to be split
+ * @return std::vector<std::string> Arguments
+ */
+inline std::vector<std::string> SplitArguments(const std::string &line)
+{
+    std::vector<std::string> splitArguments;
+    std::string argument = "";
+    bool quoted = false;
+    bool argumentStarted = false;
+    for (char character : line)
+    {
+        if (character == '"')
+        {
+            quoted = !quoted;
+            argumentStarted = true;
+        }
+        else if (!quoted && std::isspace(static_cast<unsigned char>(character)))
+        {
+            if (argumentStarted)
+                splitArguments.push_back(argument);
+            argument = "";
+            argumentStarted = false;
+        }
+        else
+        {
+            argument += character;
+            argumentStarted = true;
+        }
+    }
+    if (argumentStarted)
+        splitArguments.push_back(argument);
+    return splitArguments;
+}
+
+/**
+ * @brief Parse capabilities from a CAPABILITY response or a CAPABILITY response code (i.e. '[CAPABILITY IMAP4rev1
+ * IDLE]' in the tagged response to LOGIN)
+ *
+ * @param response Response of the server
+ * @return std::vector<std::string> Capabilities in upper case, empty if the response does not carry them
+ */
+inline std::vector<std::string> ParseCapabilities(const std::string &response)
+{
+    std::vector<std::string> capabilities;
+    std::smatch matched;
+    std::regex capabilityRegex("(?:\\[|\\* )CAPABILITY ([^\\]\r\n]*)", std::regex_constants::icase);
+    if (!std::regex_search(response, matched, capabilityRegex))
+        return capabilities;
+    std::istringstream capabilityList(matched[1].str());
+    std::string capability;
+    while (capabilityList >> capability)
+    {
+        std::transform(capability.begin(), capability.end(), capability.begin(), ::toupper);
+        capabilities.push_back(capability);
+    }
+    return capabilities;
+}
+
+/**
+ * @brief Check if a failure was caused by the connection to the server (i.e. it timed out or was closed by the
+ * server), so the sync can continue over a new connection
+ *
+ * @param returnCode Code of the failure
+ */
+inline bool IsConnectionError(ReturnCodes returnCode)
+{
+    return returnCode == SOCKET_CONNECTING || returnCode == SOCKET_TIMED_OUT || returnCode == SOCKET_WRITING ||
+           returnCode == SOCKET_READING || returnCode == CONNECTION_CLOSED || returnCode == SSL_HANDSHAKE_FAILED;
+}
+
+/**
+ * @brief Parse the highest modification sequence of a mailbox from the response to SELECT (i.e. '* OK
+ * [HIGHESTMODSEQ 715194045007]')
+ *
+ * @param response Response of the server
+ * @return unsigned long long Highest modification sequence, 0 if the mailbox does not keep them (CONDSTORE)
+ */
+inline unsigned long long ParseHighestModSeq(const std::string &response)
+{
+    std::smatch matched;
+    std::regex modSeqRegex("\\[HIGHESTMODSEQ ([0-9]+)\\]", std::regex_constants::icase);
+    if (!std::regex_search(response, matched, modSeqRegex))
+        return 0;
+    return std::stoull(matched[1]);
+}
+
+/**
+ * @brief Parse UIDs of messages from untagged FETCH responses without literals (i.e. '* 3 FETCH (UID 12 FLAGS ()
+ * MODSEQ (90))' reported for changed messages by SELECT with QRESYNC)
+ *
+ * @param response Response of the server
+ * @return std::vector<std::string> UIDs in the order of the responses
+ */
+inline std::vector<std::string> ParseFetchedUIDs(const std::string &response)
+{
+    std::vector<std::string> messageUIDs;
+    std::regex fetchRegex("\\* [0-9]+ FETCH \\([^\r\n]*?\\bUID ([0-9]+)", std::regex_constants::icase);
+    for (auto fetch = std::sregex_iterator(response.begin(), response.end(), fetchRegex);
+         fetch != std::sregex_iterator(); fetch++)
+        messageUIDs.push_back((*fetch)[1]);
+    return messageUIDs;
+}
+
+/**
+ * @brief Check if a response announces the number of messages in the mailbox (i.e. '* 23 EXISTS')
+ *
+ * @param line Line of the response
+ */
+inline bool IsExistsResponse(const std::string &line)
+{
+    std::regex existsRegex("\\* [0-9]+ EXISTS\\s*", std::regex_constants::icase);
+    return std::regex_match(line, existsRegex);
 }
 
 /**
@@ -118,15 +519,151 @@ inline bool ValidateResponse(const std::string &response, const std::string &exp
 inline Utils::ReturnCodes CheckArguments(int argc, char **args, Arguments &arguments)
 {
     int opt;
+    Utils::ReturnCodes returnCode;
     bool serverAddressSet = false;
     bool authFileSet = false;
     bool outDirectorySet = false;
-    bool certificateFileSet, certificateDirectorySet = false;
+    bool certificateFileSet = false;
+    bool certificateDirectorySet = false;
     opterr = 0;
-    while ((opt = getopt(argc, args, "a:o:p:c:C:b:Tnh")) != -1)
+    static struct option longOptions[] = {{"pipeline", required_argument, nullptr, OPTION_PIPELINE},
+                                          {"batch-count", required_argument, nullptr, OPTION_BATCH_COUNT},
+                                          {"batch-size", required_argument, nullptr, OPTION_BATCH_SIZE},
+                                          {"connections", required_argument, nullptr, OPTION_CONNECTIONS},
+                                          {"mailboxes", required_argument, nullptr, OPTION_MAILBOXES},
+                                          {"daemon", required_argument, nullptr, OPTION_DAEMON},
+                                          {"interval", required_argument, nullptr, OPTION_INTERVAL},
+                                          {"jitter", required_argument, nullptr, OPTION_JITTER},
+                                          {"workers", required_argument, nullptr, OPTION_WORKERS},
+                                          {"timeout", required_argument, nullptr, OPTION_TIMEOUT},
+                                          {"tls-cache", required_argument, nullptr, OPTION_TLS_CACHE},
+                                          {"stats", no_argument, nullptr, OPTION_STATS},
+                                          {"ktls", no_argument, nullptr, OPTION_KTLS},
+                                          {"no-compress", no_argument, nullptr, OPTION_NO_COMPRESS},
+                                          {"idle", no_argument, nullptr, OPTION_IDLE},
+                                          {"connect-timeout", required_argument, nullptr, OPTION_CONNECT_TIMEOUT},
+                                          {"chunk-size", required_argument, nullptr, OPTION_CHUNK_SIZE},
+                                          {"reconnects", required_argument, nullptr, OPTION_RECONNECTS},
+                                          {"store", required_argument, nullptr, OPTION_STORE},
+                                          {"extract", required_argument, nullptr, OPTION_EXTRACT},
+                                          {nullptr, 0, nullptr, 0}};
+    while ((opt = getopt_long(argc, args, "a:o:p:c:C:b:Tnh", longOptions, nullptr)) != -1)
     {
         switch (opt)
         {
+        case OPTION_PIPELINE:
+            if ((returnCode =
+                     ParseNumericOption(optarg, "Pipeline depth", 1, UINT32_MAX, arguments.Options.PipelineDepth)))
+                return returnCode;
+            break;
+        case OPTION_BATCH_COUNT:
+            if ((returnCode = ParseNumericOption(optarg, "Batch count", 1, UINT32_MAX, arguments.Options.BatchCount)))
+                return returnCode;
+            break;
+        case OPTION_BATCH_SIZE:
+            if ((returnCode = ParseNumericOption(optarg, "Batch size", 1, UINT32_MAX, arguments.Options.BatchBytes)))
+                return returnCode;
+            break;
+        case OPTION_CONNECTIONS:
+            if ((returnCode =
+                     ParseNumericOption(optarg, "Number of connections", 1, UINT32_MAX, arguments.Options.Connections)))
+                return returnCode;
+            break;
+        case OPTION_MAILBOXES:
+            if (optarg[0] == '-')
+            {
+                PrintError(Utils::ARGS_MISSING_OPTION, "Missing required argument option");
+                return Utils::ARGS_MISSING_OPTION;
+            }
+            arguments.MailBoxPattern = optarg;
+            break;
+        case OPTION_DAEMON:
+            if (optarg[0] == '-')
+            {
+                PrintError(Utils::ARGS_MISSING_OPTION, "Missing required argument option");
+                return Utils::ARGS_MISSING_OPTION;
+            }
+            arguments.ConfigFilePath = optarg;
+            break;
+        case OPTION_INTERVAL:
+            if ((returnCode = ParseNumericOption(optarg, "Sync interval", 1, UINT32_MAX, arguments.SyncInterval)))
+                return returnCode;
+            break;
+        case OPTION_JITTER:
+            if ((returnCode = ParseNumericOption(optarg, "Sync jitter", 0, UINT32_MAX, arguments.SyncJitter)))
+                return returnCode;
+            break;
+        case OPTION_WORKERS:
+            if ((returnCode = ParseNumericOption(optarg, "Number of workers", 1, UINT32_MAX, arguments.Workers)))
+                return returnCode;
+            break;
+        case OPTION_TIMEOUT:
+            if ((returnCode = ParseNumericOption(optarg, "Timeout", 1, MAX_TIMEOUT, arguments.Options.Timeout)))
+                return returnCode;
+            break;
+        case OPTION_CONNECT_TIMEOUT:
+            if ((returnCode =
+                     ParseNumericOption(optarg, "Connect timeout", 1, MAX_TIMEOUT, arguments.Options.ConnectTimeout)))
+                return returnCode;
+            break;
+        case OPTION_CHUNK_SIZE:
+            if ((returnCode = ParseNumericOption(optarg, "Chunk size", 1, UINT32_MAX, arguments.Options.ChunkBytes)))
+                return returnCode;
+            break;
+        case OPTION_RECONNECTS:
+            // Reconnecting is turned off by 0
+            if ((returnCode = ParseNumericOption(optarg, "Number of reconnects", 0, UINT32_MAX,
+                                                 arguments.Options.Reconnects)))
+                return returnCode;
+            break;
+        case OPTION_STORE:
+            if (optarg[0] == '-')
+            {
+                PrintError(Utils::ARGS_MISSING_OPTION, "Missing required argument option");
+                return Utils::ARGS_MISSING_OPTION;
+            }
+            if (!strcmp(optarg, "flat"))
+                arguments.Options.Store = STORE_FLAT;
+            else if (!strcmp(optarg, "maildir"))
+                arguments.Options.Store = STORE_MAILDIR;
+            else if (!strcmp(optarg, "sharded"))
+                arguments.Options.Store = STORE_SHARDED;
+            else if (!strcmp(optarg, "dedup"))
+                arguments.Options.Store = STORE_DEDUP;
+            else if (!strcmp(optarg, "archive"))
+                arguments.Options.Store = STORE_ARCHIVE;
+            else
+                return PrintError(Utils::ARGS_INVALID_VALUE,
+                                  "Store has to be one of: flat, maildir, sharded, dedup, archive");
+            break;
+        case OPTION_EXTRACT:
+            if (optarg[0] == '-')
+            {
+                PrintError(Utils::ARGS_MISSING_OPTION, "Missing required argument option");
+                return Utils::ARGS_MISSING_OPTION;
+            }
+            arguments.ExtractPath = optarg;
+            break;
+        case OPTION_TLS_CACHE:
+            if (optarg[0] == '-')
+            {
+                PrintError(Utils::ARGS_MISSING_OPTION, "Missing required argument option");
+                return Utils::ARGS_MISSING_OPTION;
+            }
+            arguments.Options.TlsCachePath = optarg;
+            break;
+        case OPTION_STATS:
+            arguments.PrintStatistics = true;
+            break;
+        case OPTION_KTLS:
+            arguments.Options.KernelTls = true;
+            break;
+        case OPTION_NO_COMPRESS:
+            arguments.Options.Compress = false;
+            break;
+        case OPTION_IDLE:
+            arguments.Idle = true;
+            break;
         case 'p':
             if (optarg[0] == '-')
             {
@@ -249,8 +786,15 @@ inline Utils::ReturnCodes CheckArguments(int argc, char **args, Arguments &argum
             outDirectorySet = true;
             break;
         case '?':
-            // Handling '-a', '-o', '-b', '-c', '-C', '-p' being last argument and without its required option
-            if (optopt == 'a' || optopt == 'o' || optopt == 'b' || optopt == 'c' || optopt == 'C' || optopt == 'p')
+            // Handling '-a', '-o', '-b', '-c', '-C', '-p' and long options being last argument and without their
+            // required option
+            if (optopt == 'a' || optopt == 'o' || optopt == 'b' || optopt == 'c' || optopt == 'C' || optopt == 'p' ||
+                optopt == OPTION_PIPELINE || optopt == OPTION_BATCH_COUNT || optopt == OPTION_BATCH_SIZE ||
+                optopt == OPTION_CONNECTIONS || optopt == OPTION_MAILBOXES || optopt == OPTION_DAEMON ||
+                optopt == OPTION_INTERVAL || optopt == OPTION_JITTER || optopt == OPTION_WORKERS ||
+                optopt == OPTION_TIMEOUT || optopt == OPTION_TLS_CACHE || optopt == OPTION_CONNECT_TIMEOUT ||
+                optopt == OPTION_CHUNK_SIZE || optopt == OPTION_RECONNECTS || optopt == OPTION_STORE ||
+                optopt == OPTION_EXTRACT)
             {
                 PrintError(Utils::ARGS_MISSING_OPTION, "Missing required argument option");
                 return Utils::ARGS_MISSING_OPTION;
@@ -263,12 +807,37 @@ inline Utils::ReturnCodes CheckArguments(int argc, char **args, Arguments &argum
         }
     }
 
-    for (int i = optind; i < argc; i++)
+    // Positional arguments are names of messages to be extracted, otherwise the only one is the server
+    if (!arguments.ExtractPath.empty())
+        arguments.ExtractNames.assign(args + optind, args + argc);
+    else if (argc - optind > 1)
+        return PrintError(Utils::ARGS_UNKNOWN_ARGUMENT, "Unknown argument");
+    else if (argc - optind == 1)
     {
-        arguments.ServerAddress = args[i];
+        arguments.ServerAddress = args[optind];
         serverAddressSet = true;
     }
 
+    // Messages are extracted from an archive without connecting to any server
+    if (!arguments.ExtractPath.empty())
+    {
+        struct stat buffer;
+        if (!outDirectorySet)
+            return PrintError(Utils::ARGS_MISSING_REQUIRED, "Missing required argument");
+        if (stat(arguments.OutDirectoryPath.c_str(), &buffer) != 0)
+            return PrintError(Utils::OUT_DIR_NONEXISTENT, "Output directory does not exist");
+        return Utils::IMAPCL_SUCCESS;
+    }
+
+    // Accounts of the daemon are given by its config file
+    if (!arguments.ConfigFilePath.empty())
+    {
+        struct stat buffer;
+        if (stat(arguments.ConfigFilePath.c_str(), &buffer) != 0)
+            return PrintError(Utils::CONFIG_FILE_OPEN, "Config file does not exist");
+        return Utils::IMAPCL_SUCCESS;
+    }
+
     if (!serverAddressSet)
     {
         PrintError(Utils::ARGS_MISSING_SERVER, "Missing server address");
@@ -344,6 +913,19 @@ inline Utils::ReturnCodes CheckArguments(int argc, char **args, Arguments &argum
     if (!arguments.Encrypted && (certificateFileSet || certificateDirectorySet))
         return Utils::PrintError(Utils::ARGS_NOT_ENRYPTED, "Tried passing certificates when not encrypted");
 
+    if (arguments.Idle && !arguments.MailBoxPattern.empty())
+        return PrintError(Utils::ARGS_INVALID_VALUE, "IDLE can not be used with --mailboxes");
+
+    if (!arguments.Encrypted && arguments.Options.KernelTls)
+        return Utils::PrintError(Utils::ARGS_NOT_ENRYPTED, "Tried enabling kernel TLS when not encrypted");
+
+    if (!arguments.Options.TlsCachePath.empty())
+    {
+        struct stat buffer;
+        if (stat(arguments.Options.TlsCachePath.c_str(), &buffer) != 0 || !S_ISDIR(buffer.st_mode))
+            return PrintError(Utils::ARGS_INVALID_VALUE, "TLS cache directory does not exist");
+    }
+
     return Utils::IMAPCL_SUCCESS;
 }
 } // namespace Utils
@@ -0,0 +1,128 @@
+/**
+ * @file ConnectionRace.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of ConnectionRace class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/ConnectionRace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+ConnectionRace::ConnectionRace(const struct addrinfo *addresses)
+    : EpollDescriptor(epoll_create1(EPOLL_CLOEXEC)), Addresses(InterleaveFamilies(addresses)), NextAddress(0)
+{
+}
+
+ConnectionRace::~ConnectionRace()
+{
+    for (int descriptor : this->PendingDescriptors)
+        close(descriptor);
+    if (this->EpollDescriptor >= 0)
+        close(this->EpollDescriptor);
+}
+
+std::vector<const struct addrinfo *> ConnectionRace::InterleaveFamilies(const struct addrinfo *addresses)
+{
+    std::vector<const struct addrinfo *> preferred;
+    std::vector<const struct addrinfo *> other;
+    for (const struct addrinfo *address = addresses; address; address = address->ai_next)
+        (address->ai_family == addresses->ai_family ? preferred : other).push_back(address);
+    std::vector<const struct addrinfo *> interleaved;
+    for (std::size_t i = 0; i < std::max(preferred.size(), other.size()); i++)
+    {
+        if (i < preferred.size())
+            interleaved.push_back(preferred[i]);
+        if (i < other.size())
+            interleaved.push_back(other[i]);
+    }
+    return interleaved;
+}
+
+void ConnectionRace::Abandon(int descriptor)
+{
+    epoll_ctl(this->EpollDescriptor, EPOLL_CTL_DEL, descriptor, nullptr);
+    close(descriptor);
+    this->PendingDescriptors.erase(
+        std::find(this->PendingDescriptors.begin(), this->PendingDescriptors.end(), descriptor));
+}
+
+int ConnectionRace::StartAttempt()
+{
+    while (this->NextAddress < this->Addresses.size())
+    {
+        const struct addrinfo *address = this->Addresses[this->NextAddress++];
+        int descriptor = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK, address->ai_protocol);
+        if (descriptor < 0)
+            continue;
+        if (connect(descriptor, address->ai_addr, address->ai_addrlen) == 0)
+            return descriptor;
+        struct epoll_event event = {};
+        event.events = EPOLLOUT;
+        event.data.fd = descriptor;
+        // Unreachable network is reported right away, the next address is tried without waiting
+        if (errno != EINPROGRESS || epoll_ctl(this->EpollDescriptor, EPOLL_CTL_ADD, descriptor, &event) == -1)
+        {
+            close(descriptor);
+            continue;
+        }
+        this->PendingDescriptors.push_back(descriptor);
+        break;
+    }
+    return -1;
+}
+
+int ConnectionRace::Connect(std::chrono::milliseconds attemptDelay, std::chrono::steady_clock::time_point deadline)
+{
+    if (this->EpollDescriptor < 0)
+        return -1;
+    auto nextAttempt = std::chrono::steady_clock::now();
+    while (true)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextAttempt && this->NextAddress < this->Addresses.size())
+        {
+            int descriptor = this->StartAttempt();
+            if (descriptor >= 0)
+                return descriptor;
+            nextAttempt = now + attemptDelay;
+        }
+        if (this->PendingDescriptors.empty() && this->NextAddress >= this->Addresses.size())
+            return -1;
+        if (now >= deadline)
+            return -1;
+        auto wakeUp = deadline;
+        if (this->NextAddress < this->Addresses.size())
+            wakeUp = std::min(wakeUp, nextAttempt);
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(wakeUp - now);
+        struct epoll_event events[8];
+        int ready = epoll_wait(this->EpollDescriptor, events, 8, std::clamp<long>(remaining.count(), 0, INT_MAX));
+        if (ready == -1 && errno != EINTR)
+            return -1;
+        for (int i = 0; i < ready; i++)
+        {
+            int descriptor = events[i].data.fd;
+            int error = 0;
+            socklen_t errorLength = sizeof(error);
+            if (getsockopt(descriptor, SOL_SOCKET, SO_ERROR, &error, &errorLength) == 0 && error == 0)
+            {
+                // Winner is handed over to the caller, the remaining attempts are closed by the destructor
+                epoll_ctl(this->EpollDescriptor, EPOLL_CTL_DEL, descriptor, nullptr);
+                this->PendingDescriptors.erase(
+                    std::find(this->PendingDescriptors.begin(), this->PendingDescriptors.end(), descriptor));
+                return descriptor;
+            }
+            // Failed attempt does not hold back the next address
+            this->Abandon(descriptor);
+            nextAttempt = std::chrono::steady_clock::now();
+        }
+    }
+}
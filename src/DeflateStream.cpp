@@ -0,0 +1,88 @@
+/**
+ * @file DeflateStream.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of DeflateStream class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/DeflateStream.h"
+
+#include <cstring>
+
+DeflateStream::DeflateStream() : Initialized(false), OutputFull(false)
+{
+    std::memset(&this->Inflater, 0, sizeof(this->Inflater));
+    std::memset(&this->Deflater, 0, sizeof(this->Deflater));
+    // Negative window bits select raw deflate streams without zlib headers, as required by RFC 4978
+    if (inflateInit2(&this->Inflater, -MAX_WBITS) != Z_OK)
+        return;
+    if (deflateInit2(&this->Deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        inflateEnd(&this->Inflater);
+        return;
+    }
+    this->Initialized = true;
+}
+
+DeflateStream::~DeflateStream()
+{
+    if (!this->Initialized)
+        return;
+    inflateEnd(&this->Inflater);
+    deflateEnd(&this->Deflater);
+}
+
+bool DeflateStream::IsInitialized() const
+{
+    return this->Initialized;
+}
+
+bool DeflateStream::HasPending() const
+{
+    return this->Inflater.avail_in > 0 || this->OutputFull;
+}
+
+void DeflateStream::SetInput(const char *data, std::size_t length)
+{
+    this->Inflater.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    this->Inflater.avail_in = length;
+}
+
+long DeflateStream::Inflate(char *data, std::size_t length)
+{
+    this->Inflater.next_out = reinterpret_cast<Bytef *>(data);
+    this->Inflater.avail_out = length;
+    // Inflating even without new input, the previous call may have left output of the last input pending
+    while (this->Inflater.avail_out == length)
+    {
+        int result = inflate(&this->Inflater, Z_SYNC_FLUSH);
+        if (result == Z_BUF_ERROR || result == Z_STREAM_END)
+            break;
+        if (result != Z_OK)
+            return -1;
+        if (this->Inflater.avail_in == 0 && this->Inflater.avail_out == length)
+            break;
+    }
+    this->OutputFull = this->Inflater.avail_out == 0;
+    return length - this->Inflater.avail_out;
+}
+
+bool DeflateStream::Deflate(const char *data, std::size_t length, std::string &compressed)
+{
+    this->Deflater.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    this->Deflater.avail_in = length;
+    do
+    {
+        std::size_t start = compressed.length();
+        compressed.resize(start + DEFLATE_CHUNK_SIZE);
+        this->Deflater.next_out = reinterpret_cast<Bytef *>(compressed.data() + start);
+        this->Deflater.avail_out = DEFLATE_CHUNK_SIZE;
+        if (deflate(&this->Deflater, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+            return false;
+        compressed.resize(start + DEFLATE_CHUNK_SIZE - this->Deflater.avail_out);
+    } while (this->Deflater.avail_out == 0);
+    return true;
+}
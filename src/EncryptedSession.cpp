@@ -9,361 +9,250 @@
  *
  */
 #include "../include/EncryptedSession.h"
+#include "../include/SecureContextFactory.h"
+#include "../include/Statistics.h"
 
+#include <arpa/inet.h>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
 #include <openssl/ssl.h>
 #include <string>
-
-#include "../include/HeaderMessage.h"
-#include "../include/Message.h"
+#include <unistd.h>
 
 EncryptedSession::EncryptedSession(const std::string &serverHostname, const std::string &port,
                                    const std::string &username, const std::string &password,
                                    const std::string &outDirectoryPath, const std::string &mailBox,
-                                   const std::string &certificateFile, const std::string &certificateFileDirectoryPath)
-    : Session(serverHostname, port, username, password, outDirectoryPath, mailBox), CertificateFile(certificateFile),
-      CertificateFileDirectoryPath(certificateFileDirectoryPath)
+                                   const std::string &certificateFile, const std::string &certificateFileDirectoryPath,
+                                   const Utils::SessionOptions &options)
+    : Session(serverHostname, port, username, password, outDirectoryPath, mailBox, options),
+      SecureContext(nullptr), SecureConnection(nullptr), CertificateFile(certificateFile),
+      CertificateFileDirectoryPath(certificateFileDirectoryPath), KernelReceive(false), SplicePipe{-1, -1}
 {
+    std::string cacheDirectoryPath =
+        this->Options.TlsCachePath.empty() ? this->OutDirectoryPath : this->Options.TlsCachePath;
+    this->SessionCacheFilePath = cacheDirectoryPath + "/." + this->ServerHostname + "_" + this->Port + "_tls_session";
 }
 
 EncryptedSession::~EncryptedSession()
 {
-    SSL_shutdown(this->SecureConnection);
+    if (this->SecureConnection != nullptr)
+        SSL_shutdown(this->SecureConnection);
     SSL_free(this->SecureConnection);
     SSL_CTX_free(this->SecureContext);
+    if (this->SplicePipe[0] >= 0)
+    {
+        close(this->SplicePipe[0]);
+        close(this->SplicePipe[1]);
+    }
 }
 
-Utils::ReturnCodes EncryptedSession::ReceiveUntaggedResponse()
+long EncryptedSession::ReceiveData(char *data, std::size_t length)
 {
+    auto deadline = this->OperationDeadline();
     while (true)
     {
-        unsigned long int received = SSL_read(this->SecureConnection, this->Buffer.data(), BUFFER_SIZE);
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
-            return Utils::PrintError(Utils::SOCKET_TIMED_OUT, "Timed out");
-        if (received != 0)
+        errno = 0;
+        int received = SSL_read(this->SecureConnection, data, length);
+        if (received > 0)
+            return received;
+        // Reading a record may need to write as well (i.e. during renegotiation)
+        switch (SSL_get_error(this->SecureConnection, received))
         {
-            this->FullResponse += this->Buffer.substr(0, received);
-            // Keep listening on the port until '*' + OK/NO/BAD is present, so we can stop reading
-            if (!Utils::ValidateResponse(this->FullResponse, "\\*\\sOK") ||
-                !Utils::ValidateResponse(this->FullResponse, "\\*\\sNO") ||
-                !Utils::ValidateResponse(this->FullResponse, "\\*\\sBAD"))
-                break;
+        case SSL_ERROR_WANT_READ:
+            if (!this->WaitForSocket(false, deadline))
+                return -1;
+            break;
+        case SSL_ERROR_WANT_WRITE:
+            if (!this->WaitForSocket(true, deadline))
+                return -1;
+            break;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            if (errno == 0)
+                return 0;
+            return -1;
+        default:
+            errno = EIO;
+            return -1;
         }
     }
-    this->Buffer = std::string("", BUFFER_SIZE);
-    return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes EncryptedSession::ReceiveTaggedResponse()
+long EncryptedSession::SendData(const char *data, std::size_t length)
 {
+    auto deadline = this->OperationDeadline();
     while (true)
     {
-        unsigned long int received = SSL_read(this->SecureConnection, this->Buffer.data(), BUFFER_SIZE);
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
-            return Utils::PrintError(Utils::SOCKET_TIMED_OUT, "Timed out");
-        if (received != 0)
+        // Interrupted write has to be retried with the same arguments
+        int sent = SSL_write(this->SecureConnection, data, length);
+        if (sent > 0)
+            return sent;
+        switch (SSL_get_error(this->SecureConnection, sent))
         {
-            this->FullResponse += this->Buffer.substr(0, received);
-            // Keep listening on the port until 'current tag' + OK/NO/BAD is present, so we can stop reading
-            if (!Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK") ||
-                !Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sNO") ||
-                !Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sBAD"))
-                break;
+        case SSL_ERROR_WANT_READ:
+            if (!this->WaitForSocket(false, deadline))
+                return -1;
+            break;
+        case SSL_ERROR_WANT_WRITE:
+            if (!this->WaitForSocket(true, deadline))
+                return -1;
+            break;
+        default:
+            errno = EIO;
+            return -1;
         }
     }
-    this->Buffer = std::string("", BUFFER_SIZE);
-    return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes EncryptedSession::LoadCertificates()
+Utils::ReturnCodes EncryptedSession::ReceiveLiteral(StreamedMessage &body, std::size_t length)
 {
-    if (!SSL_CTX_load_verify_dir(this->SecureContext, this->CertificateFileDirectoryPath.c_str()))
-        return Utils::CERTIFICATE_ERROR;
+    // Records already read by OpenSSL have to be received through it, compressed data has to be inflated first
+    if (!this->KernelReceive || this->Compression || SSL_has_pending(this->SecureConnection))
+        return Session::ReceiveLiteral(body, length);
+    auto deadline = this->OperationDeadline();
+    long spliced;
+    while ((spliced = splice(this->SocketDescriptor, nullptr, this->SplicePipe[1], nullptr, length,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) < 0)
+    {
+        // Control records (i.e. session tickets or alerts) can not be spliced, OpenSSL processes them
+        if (errno == EINVAL || errno == EIO)
+            return Session::ReceiveLiteral(body, length);
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return Utils::PrintError(Utils::SOCKET_READING, "Failed reading from a socket");
+        if (!this->WaitForSocket(false, deadline))
+        {
+            if (errno == EAGAIN)
+                return Utils::PrintError(Utils::SOCKET_TIMED_OUT, "Timed out");
+            return Utils::PrintError(Utils::SOCKET_READING, "Failed reading from a socket");
+        }
+    }
+    if (spliced == 0)
+        return Utils::PrintError(Utils::CONNECTION_CLOSED, "Connection closed by the server");
+    this->Parser.SkipLiteral(spliced);
+    Statistics::Add(Statistics::SPLICED_BYTES, spliced);
+    if (!body.Splice(this->SplicePipe[0], spliced))
+        return Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed writing message file");
     return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes EncryptedSession::EncryptSocket()
+bool EncryptedSession::HasPendingData()
 {
-#ifdef DEBUG
-    std::cerr << "Encrypting socket... ";
-#endif
-    SSL_load_error_strings();
-    SSL_library_init();
-    OpenSSL_add_all_algorithms();
-    // Creating SSL context
-    if ((this->SecureContext = SSL_CTX_new(TLS_client_method())) == nullptr)
-        return Utils::PrintError(Utils::SSL_CONTEXT_CREATE, "Failed creating SSL context");
-    // Verifying certificate file
-    if (this->CertificateFile != "")
-        if (!SSL_CTX_load_verify_file(this->SecureContext, this->CertificateFile.c_str()))
-            return Utils::PrintError(Utils::CERTIFICATE_ERROR, "Certificate file error");
-    // Verifying certificate directory
-    if (!SSL_CTX_load_verify_dir(this->SecureContext, this->CertificateFileDirectoryPath.c_str()))
-        return Utils::PrintError(Utils::CERTIFICATE_ERROR, "Certificate directory error");
-    SSL_CTX_set_verify(this->SecureContext, SSL_VERIFY_PEER, nullptr);
-    // Creating SSL connection from context
-    if ((this->SecureConnection = SSL_new(this->SecureContext)) == nullptr)
-        return Utils::PrintError(Utils::SSL_CONNECTION_CREATE, "Failed creating SSL connection");
-    // Setting BSD socket descriptor into SSL
-    if (!SSL_set_fd(this->SecureConnection, this->SocketDescriptor))
-        return Utils::PrintError(Utils::SSL_SET_DESCRIPTOR, "Failed setting socket descriptor to SSL");
-    // Connecting through SSL
-    if (SSL_connect(this->SecureConnection) <= 0)
-        return Utils::PrintError(Utils::SSL_HANDSHAKE_FAILED, "Failed SSL handshake");
-#ifdef DEBUG
-    std::cerr << "DONE" << std::endl;
-#endif
-    return Utils::IMAPCL_SUCCESS;
+    return Session::HasPendingData() || SSL_has_pending(this->SecureConnection);
 }
 
-Utils::ReturnCodes EncryptedSession::SendMessage(const std::string &message)
+void EncryptedSession::LoadCachedSession()
 {
-    std::string messageBuffer = "A" + std::to_string(this->CurrentTagNumber) + " ";
-    messageBuffer += message + "\n";
-    if (SSL_write(this->SecureConnection, messageBuffer.c_str(), messageBuffer.length()) <= 0)
-        return Utils::PrintError(Utils::SOCKET_WRITING, "Failed writing to a socket");
-    return Utils::IMAPCL_SUCCESS;
+    std::ifstream cacheFile(this->SessionCacheFilePath, std::ios::binary);
+    if (!cacheFile.is_open())
+        return;
+    std::string encodedSession((std::istreambuf_iterator<char>(cacheFile)), std::istreambuf_iterator<char>());
+    const unsigned char *encoded = reinterpret_cast<const unsigned char *>(encodedSession.data());
+    SSL_SESSION *session = d2i_SSL_SESSION(nullptr, &encoded, encodedSession.length());
+    if (session == nullptr)
+        return;
+    // Expired session would only make the server fall back to a full handshake
+    if (SSL_SESSION_is_resumable(session) &&
+        SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) > std::time(nullptr))
+        SSL_set_session(this->SecureConnection, session);
+    SSL_SESSION_free(session);
 }
 
-Utils::ReturnCodes EncryptedSession::Connect()
+int EncryptedSession::StoreSession(SSL *secureConnection, SSL_SESSION *session)
 {
-    if (connect(this->SocketDescriptor, Server->ai_addr, Server->ai_addrlen) == -1)
-        return Utils::PrintError(Utils::SOCKET_CONNECTING, "Connecting to socket failed");
-    if ((this->ReturnCode = this->EncryptSocket()))
-        return this->ReturnCode;
-    if ((this->ReturnCode = this->ReceiveUntaggedResponse()))
-        return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "\\*\\sOK"))
-        return Utils::PrintError(Utils::INVALID_RESPONSE, "Response is invalid");
-    this->FullResponse = "";
-    return Utils::IMAPCL_SUCCESS;
+    auto encryptedSession = static_cast<EncryptedSession *>(SSL_get_app_data(secureConnection));
+    int length;
+    if (encryptedSession == nullptr || !SSL_SESSION_is_resumable(session) ||
+        (length = i2d_SSL_SESSION(session, nullptr)) <= 0)
+        return 0;
+    std::string encodedSession(length, '\0');
+    unsigned char *encoded = reinterpret_cast<unsigned char *>(encodedSession.data());
+    i2d_SSL_SESSION(session, &encoded);
+    // Session holds the master secret, so it is written only to a file readable by the user. Connections to the same
+    // server replace the cache file by renaming, so none of them reads a partially written session
+    std::string temporaryFilePath = encryptedSession->SessionCacheFilePath + ".XXXXXX";
+    int cacheFile = mkstemp(temporaryFilePath.data());
+    if (cacheFile < 0)
+        return 0;
+    bool written = write(cacheFile, encodedSession.data(), encodedSession.length()) == length;
+    close(cacheFile);
+    if (!written || std::rename(temporaryFilePath.c_str(), encryptedSession->SessionCacheFilePath.c_str()))
+        unlink(temporaryFilePath.c_str());
+    return 0;
 }
 
-Utils::ReturnCodes EncryptedSession::Authenticate()
+std::unique_ptr<Session> EncryptedSession::CreateWorkerSession()
 {
-    if ((this->ReturnCode = this->SendMessage("LOGIN " + this->Username + " " + this->Password)))
-        return this->ReturnCode;
-    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
-        return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sNO"))
-    {
-        if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
-        {
-            this->CurrentTagNumber++;
-            this->Logout();
-            return Utils::PrintError(Utils::INVALID_RESPONSE, "Response is invalid");
-        }
-        else
-        {
-            this->FullResponse = "";
-            this->CurrentTagNumber++;
-            return Utils::IMAPCL_SUCCESS;
-        }
-    }
-    else
-    {
-        this->CurrentTagNumber++;
-        this->Logout();
-        return Utils::PrintError(Utils::AUTH_INVALID_CREDENTIALS, "Bad credentials");
-    }
-    return Utils::IMAPCL_SUCCESS;
+    return std::make_unique<EncryptedSession>(this->ServerHostname, this->Port, this->Username, this->Password,
+                                              this->OutDirectoryPath, this->MailBox, this->CertificateFile,
+                                              this->CertificateFileDirectoryPath, this->Options);
 }
 
-Utils::ReturnCodes EncryptedSession::SelectMailbox()
+Utils::ReturnCodes EncryptedSession::EncryptSocket()
 {
 #ifdef DEBUG
-    std::cerr << "Selecting mailbox " << this->MailBox << "... ";
+    std::cerr << "Encrypting socket... ";
 #endif
-    // Selecting mailbox
-    if ((this->ReturnCode = this->SendMessage("SELECT " + this->MailBox)))
-        return this->ReturnCode;
-    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+    // Context with loaded certificates is shared by all sessions using the same certificates
+    if (this->SecureContext == nullptr &&
+        (this->ReturnCode = SecureContextFactory::Acquire(this->CertificateFile, this->CertificateFileDirectoryPath,
+                                                          this->SecureContext)))
         return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
-    {
-        this->CurrentTagNumber++;
-        this->Logout();
-        return Utils::PrintError(Utils::CANT_ACCESS_MAILBOX, "Can't access mailbox");
-    }
-#ifdef DEBUG
-    std::cerr << "DONE" << std::endl;
-#endif
-#ifdef DEBUG
-    std::cerr << "Checking validity... ";
-#endif
-    // Checking UIDValidity of the mailbox
-    if ((this->ReturnCode = this->ValidateMailbox()))
+    // Creating SSL connection from context
+    if ((this->SecureConnection = SSL_new(this->SecureContext)) == nullptr)
+        return Utils::PrintError(Utils::SSL_CONNECTION_CREATE, "Failed creating SSL connection");
+    // Setting BSD socket descriptor into SSL
+    if (!SSL_set_fd(this->SecureConnection, this->SocketDescriptor))
+        return Utils::PrintError(Utils::SSL_SET_DESCRIPTOR, "Failed setting socket descriptor to SSL");
+    SSL_set_app_data(this->SecureConnection, this);
+    // Servers issue sessions for the requested name, IP addresses are not sent as the server name
+    struct in6_addr address;
+    if (inet_pton(AF_INET, this->ServerHostname.c_str(), &address) != 1 &&
+        inet_pton(AF_INET6, this->ServerHostname.c_str(), &address) != 1)
+        SSL_set_tlsext_host_name(this->SecureConnection, this->ServerHostname.c_str());
+    this->LoadCachedSession();
+    // Kernel takes over the records only if it supports the negotiated cipher, OpenSSL falls back on its own
+    if (this->Options.KernelTls)
+        SSL_set_options(this->SecureConnection, SSL_OP_ENABLE_KTLS);
+    // Connecting through SSL, the handshake is driven by readiness of the non-blocking socket
+    auto deadline = this->OperationDeadline();
+    int connected;
+    while ((connected = SSL_connect(this->SecureConnection)) <= 0)
     {
-        this->CurrentTagNumber++;
-        this->Logout();
-        return this->ReturnCode;
+        int error = SSL_get_error(this->SecureConnection, connected);
+        if ((error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) ||
+            !this->WaitForSocket(error == SSL_ERROR_WANT_WRITE, deadline))
+            return Utils::PrintError(Utils::SSL_HANDSHAKE_FAILED, "Failed SSL handshake");
     }
-#ifdef DEBUG
-    std::cerr << "DONE" << std::endl;
-#endif
-    this->FullResponse = "";
-    this->CurrentTagNumber++;
-    return Utils::IMAPCL_SUCCESS;
-}
-
-std::tuple<std::vector<std::string>, Utils::ReturnCodes> EncryptedSession::SearchMailbox(const std::string &searchKey)
-{
-    std::vector<std::string> messageUIDs;
-#ifdef DEBUG
-    std::cerr << "Searching for " << searchKey << "... ";
-#endif
-    // Searching for all mail in selected mailbox
-    if ((this->ReturnCode = this->SendMessage("UID SEARCH " + searchKey)))
-        return {messageUIDs, this->ReturnCode};
-    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
-        return {messageUIDs, this->ReturnCode};
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+    bool resumed = SSL_session_reused(this->SecureConnection);
+    Statistics::Add(resumed ? Statistics::RESUMED_HANDSHAKES : Statistics::FULL_HANDSHAKES);
+    if (this->Options.KernelTls)
     {
-        this->CurrentTagNumber++;
-        this->Logout();
-        return {messageUIDs, Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response")};
-    }
+        this->KernelReceive = BIO_get_ktls_recv(SSL_get_rbio(this->SecureConnection)) &&
+                              (this->SplicePipe[0] >= 0 || pipe2(this->SplicePipe, O_CLOEXEC) == 0);
+        Statistics::Add(this->KernelReceive ? Statistics::KERNEL_TLS_RECEIVE : Statistics::USERSPACE_TLS);
 #ifdef DEBUG
-    std::cerr << "DONE" << std::endl;
+        std::cerr << (this->KernelReceive ? "Kernel TLS receive enabled... " : "Kernel TLS unavailable... ");
 #endif
-    // Extracting line with UIDs of mail
-    std::regex removeSecondLine("A" + std::to_string(this->CurrentTagNumber) + "[\\s\\S]+",
-                                std::regex_constants::icase);
-    this->FullResponse = std::regex_replace(this->FullResponse, removeSecondLine, "");
-    std::regex regex("[0-9]+", std::regex_constants::icase);
-    std::smatch match;
-    std::string::const_iterator start(this->FullResponse.cbegin());
-    while (std::regex_search(start, this->FullResponse.cend(), match, regex))
-    {
-        messageUIDs.push_back(match[0]);
-        start = match.suffix().first;
     }
-
-    this->FullResponse = "";
-    this->CurrentTagNumber++;
-    return {messageUIDs, Utils::IMAPCL_SUCCESS};
-}
-
-Utils::ReturnCodes EncryptedSession::FetchMail(const bool headersOnly, const bool newMailOnly)
-{
-    if ((this->ReturnCode = this->SelectMailbox()))
-        return this->ReturnCode;
-    std::vector<std::string> messageUIDs;
-    if (newMailOnly)
-        std::tie(messageUIDs, this->ReturnCode) = this->SearchMailbox("NEW");
-    else
-        std::tie(messageUIDs, this->ReturnCode) = this->SearchMailbox("ALL");
-    if (this->ReturnCode == Utils::SOCKET_WRITING)
-        return this->ReturnCode;
-    else if (this->ReturnCode > 0)
-    {
-        this->CurrentTagNumber++;
-        this->Logout();
-        return this->ReturnCode;
-    }
-    std::vector<std::string> localMessagesUIDs;
-    if (headersOnly)
-        localMessagesUIDs = this->SearchLocalMailDirectoryForAll();
-    else
-        localMessagesUIDs = this->SearchLocalMailDirectoryForFullMail();
-    unsigned int numOfDownloaded = 0;
-    for (auto x : messageUIDs)
-    {
-        bool mailNotToBeDownloaded = false;
-        for (auto m : localMessagesUIDs)
-            if (!x.compare(m))
-                mailNotToBeDownloaded = true;
-        if (mailNotToBeDownloaded)
-            continue;
-        std::unique_ptr<Message> message;
-        if (headersOnly)
-        {
-
-            // Fetching headers
-            this->SendMessage("UID FETCH " + x + " BODY.PEEK[HEADER]");
-#ifdef DEBUG
-            std::cerr << "Fetching headers of message with UID: " << x << " in progress...";
-#endif
-            if ((this->ReturnCode = this->ReceiveTaggedResponse()))
-                return this->ReturnCode;
-            if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
-            {
-                this->CurrentTagNumber++;
-                this->Logout();
-                return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
-            }
-#ifdef DEBUG
-            std::cerr << " DONE" << std::endl;
-#endif
-            message = std::make_unique<HeaderMessage>(x, this->FullResponse);
-        }
-        else
-        {
-            // Fetching full messages
-            // Retrieving size of each message
-            this->SendMessage("UID FETCH " + x + " RFC822.SIZE");
-            if ((this->ReturnCode = this->ReceiveTaggedResponse()))
-                return this->ReturnCode;
-            if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
-            {
-                this->CurrentTagNumber++;
-                this->Logout();
-                return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
-            }
-            std::regex rfcSizeRegex("RFC822.SIZE\\s([0-9]+)", std::regex_constants::icase);
-            std::smatch rfcSizeMatch;
-            std::regex_search(this->FullResponse, rfcSizeMatch, rfcSizeRegex);
-            std::string rfcSize = rfcSizeMatch[1];
-            this->FullResponse = "";
-            this->CurrentTagNumber++;
-            // Fetching mail
-            this->SendMessage("UID FETCH " + x + " BODY[]");
-#ifdef DEBUG
-            std::cerr << "Fetching full message with UID: " << x << " in progress...";
-#endif
-            if ((this->ReturnCode = this->ReceiveTaggedResponse()))
-                return this->ReturnCode;
-            if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
-            {
-                this->CurrentTagNumber++;
-                this->Logout();
-                return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
-            }
 #ifdef DEBUG
-            std::cerr << " DONE" << std::endl;
+    std::cerr << (resumed ? "DONE (resumed)" : "DONE") << std::endl;
 #endif
-            message = std::make_unique<Message>(x, this->FullResponse, stoi(rfcSize));
-        }
-        message->ParseFileName(this->ServerHostname, this->MailBox);
-        message->ParseMessageBody();
-        message->DumpToFile(this->OutDirectoryPath);
-        this->FullResponse = "";
-        this->CurrentTagNumber++;
-        numOfDownloaded++;
-    }
-    if (headersOnly)
-        if (newMailOnly)
-            std::cout << "Downloaded: " << numOfDownloaded << " new header(s) from " << this->MailBox << "\n";
-        else
-            std::cout << "Downloaded: " << numOfDownloaded << " header(s) from " << this->MailBox << "\n";
-    else
-    {
-        if (newMailOnly)
-            std::cout << "Downloaded: " << numOfDownloaded << " new message(s) from " << this->MailBox << "\n";
-        else
-            std::cout << "Downloaded: " << numOfDownloaded << " message(s) from " << this->MailBox << "\n";
-    }
     return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes EncryptedSession::Logout()
+Utils::ReturnCodes EncryptedSession::Connect()
 {
-    if ((this->ReturnCode = this->SendMessage("LOGOUT")))
+    if ((this->ReturnCode = this->ConnectSocket()))
         return this->ReturnCode;
-    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+    if ((this->ReturnCode = this->EncryptSocket()))
+        return this->ReturnCode;
+    if ((this->ReturnCode = this->ReceiveUntaggedResponse()))
         return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
         return Utils::PrintError(Utils::INVALID_RESPONSE, "Response is invalid");
     this->FullResponse = "";
-    this->CurrentTagNumber++;
     return Utils::IMAPCL_SUCCESS;
 }
@@ -0,0 +1,45 @@
+/**
+ * @file FetchQueue.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of FetchQueue class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/FetchQueue.h"
+
+FetchQueue::FetchQueue(unsigned int numOfWorkers) : Queues(numOfWorkers), NextQueue(0)
+{
+}
+
+FetchQueue::~FetchQueue() = default;
+
+void FetchQueue::Push(const FetchCommand &command)
+{
+    std::lock_guard<std::mutex> lock(this->QueuesMutex);
+    this->Queues[this->NextQueue].push_back(command);
+    this->NextQueue = (this->NextQueue + 1) % this->Queues.size();
+}
+
+bool FetchQueue::Pop(unsigned int worker, FetchCommand &command)
+{
+    std::lock_guard<std::mutex> lock(this->QueuesMutex);
+    if (!this->Queues[worker].empty())
+    {
+        command = this->Queues[worker].front();
+        this->Queues[worker].pop_front();
+        return true;
+    }
+    // Stealing from the back of the longest queue
+    std::deque<FetchCommand> *victim = nullptr;
+    for (auto &queue : this->Queues)
+        if (!queue.empty() && (victim == nullptr || queue.size() > victim->size()))
+            victim = &queue;
+    if (victim == nullptr)
+        return false;
+    command = victim->back();
+    victim->pop_back();
+    return true;
+}
@@ -43,6 +43,11 @@ void HeaderMessage::ParseFileName(const std::string &serverHostname, const std::
     this->FileName += "_h.eml";
 }
 
+bool HeaderMessage::IsHeadersOnly() const
+{
+    return true;
+}
+
 void HeaderMessage::ParseMessageBody()
 {
     // Removing start and end of the fetch response
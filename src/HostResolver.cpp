@@ -0,0 +1,34 @@
+/**
+ * @file HostResolver.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of HostResolver class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/HostResolver.h"
+
+std::map<std::string, HostResolver::CachedAddresses> HostResolver::Cache;
+std::mutex HostResolver::CacheMutex;
+
+std::shared_ptr<struct addrinfo> HostResolver::Resolve(const std::string &hostname, const std::string &port,
+                                                       const struct addrinfo &hints)
+{
+    std::string key = hostname + ":" + port + ":" + std::to_string(hints.ai_family);
+    {
+        std::lock_guard<std::mutex> lock(CacheMutex);
+        auto cached = Cache.find(key);
+        if (cached != Cache.end() && cached->second.Expiration > std::chrono::steady_clock::now())
+            return cached->second.Addresses;
+    }
+    // Resolving without holding the lock, so lookups of different servers do not wait for each other
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(hostname.c_str(), port.c_str(), &hints, &result) != 0)
+        return nullptr;
+    std::shared_ptr<struct addrinfo> addresses(result, freeaddrinfo);
+    std::lock_guard<std::mutex> lock(CacheMutex);
+    Cache[key] = {addresses, std::chrono::steady_clock::now() + std::chrono::seconds(RESOLVER_CACHE_TTL)};
+    return addresses;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file LocalIndex.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of LocalIndex class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/LocalIndex.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+LocalIndex::LocalIndex(const std::string &filePath) : FilePath(filePath), AppendDescriptor(-1)
+{
+}
+
+LocalIndex::~LocalIndex()
+{
+    if (this->AppendDescriptor >= 0)
+        close(this->AppendDescriptor);
+}
+
+bool LocalIndex::Load(const std::string &validity)
+{
+    this->Messages = UIDSet();
+    this->Headers = UIDSet();
+    std::ifstream file(this->FilePath, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    std::string line;
+    if (!std::getline(file, line) || line != std::string(INDEX_SIGNATURE) + " " + validity)
+        return false;
+    std::size_t records = 0;
+    bool tornRecord = false;
+    while (std::getline(file, line))
+    {
+        // Last record without its line end was torn by a crash while it was appended
+        if (file.eof())
+        {
+            tornRecord = true;
+            break;
+        }
+        uint32_t first = 0;
+        uint32_t last = 0;
+        if (line.length() < 3 || (line[0] != STORED_HEADERS && line[0] != STORED_MESSAGE) || line[1] != ' ' ||
+            !ParseRange(line.substr(2), first, last))
+            return false;
+        (line[0] == STORED_MESSAGE ? this->Messages : this->Headers).Insert(first, last);
+        records++;
+    }
+    // Full message replaces headers stored before, never the other way around
+    this->Headers = this->Headers.Difference(this->Messages);
+    // Log of records is compacted once it is mostly made of single UIDs or superseded records
+    if (tornRecord ||
+        records > 2 * (this->Messages.GetIntervals().size() + this->Headers.GetIntervals().size()) + 1024)
+        return this->Rebuild(validity, UIDSet(this->Messages), UIDSet(this->Headers));
+    return true;
+}
+
+bool LocalIndex::ParseRange(const std::string &range, uint32_t &first, uint32_t &last)
+{
+    std::size_t separator = range.find(':');
+    std::string firstUID = range.substr(0, separator);
+    std::string lastUID = separator == std::string::npos ? firstUID : range.substr(separator + 1);
+    return UIDSet::ParseUID(firstUID, first) && UIDSet::ParseUID(lastUID, last) && first <= last;
+}
+
+bool LocalIndex::Rebuild(const std::string &validity, const UIDSet &messages, const UIDSet &headers)
+{
+    if (this->AppendDescriptor >= 0)
+        close(this->AppendDescriptor);
+    this->AppendDescriptor = -1;
+    this->Messages = messages;
+    this->Headers = headers.Difference(messages);
+    std::string temporaryFilePath = this->FilePath + ".tmp";
+    std::ofstream file(temporaryFilePath, std::ios::binary | std::ios::trunc);
+    file << INDEX_SIGNATURE << " " << validity << "\n";
+    for (const auto &stored : {std::make_pair(STORED_MESSAGE, &this->Messages),
+                               std::make_pair(STORED_HEADERS, &this->Headers)})
+        for (const auto &interval : stored.second->GetIntervals())
+        {
+            file << static_cast<char>(stored.first) << " " << interval.First;
+            if (interval.Last != interval.First)
+                file << ":" << interval.Last;
+            file << "\n";
+        }
+    file.close();
+    if (!file.good() || std::rename(temporaryFilePath.c_str(), this->FilePath.c_str()) != 0)
+    {
+        std::remove(temporaryFilePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool LocalIndex::Add(uint32_t messageUID, StoredItem item)
+{
+    if (item == STORED_MESSAGE)
+    {
+        this->Messages.Insert(messageUID);
+        this->Headers.Erase(messageUID);
+    }
+    else if (!this->Messages.Contains(messageUID))
+        this->Headers.Insert(messageUID);
+    if (this->AppendDescriptor < 0 &&
+        (this->AppendDescriptor = open(this->FilePath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC)) < 0)
+        return false;
+    // Whole record is appended by a single write, so records of connections storing the same mailbox do not mix
+    std::string record = std::string(1, static_cast<char>(item)) + " " + std::to_string(messageUID) + "\n";
+    return write(this->AppendDescriptor, record.data(), record.length()) == static_cast<long>(record.length());
+}
+
+const UIDSet &LocalIndex::GetMessages() const
+{
+    return this->Messages;
+}
+
+const UIDSet &LocalIndex::GetHeaders() const
+{
+    return this->Headers;
+}
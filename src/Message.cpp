@@ -10,21 +10,27 @@
  */
 #include "../include/Message.h"
 
-#include <fstream>
 #include <iostream>
 #include <regex>
 
+#include "../include/MessageStore.h"
+
 Message::Message()
 {
 }
 
-Message::Message(const std::string &messageUID, const std::string &responseString, int rfcSize)
+Message::Message(const std::string &messageUID, const std::string &responseString, unsigned long rfcSize)
     : MessageUID(messageUID), ResponseString(responseString), FileName(""), MessageBody(""), RfcSize(rfcSize)
 {
 }
 
 Message::~Message() = default;
 
+void Message::SetMessageUID(const std::string &messageUID)
+{
+    this->MessageUID = messageUID;
+}
+
 void Message::ParseFileName(const std::string &serverHostname, const std::string &mailbox)
 {
 
@@ -57,9 +63,12 @@ void Message::ParseMessageBody()
     this->MessageBody = this->MessageBody.substr(2, this->RfcSize);
 }
 
-void Message::DumpToFile(const std::string &outDirectoryPath)
+bool Message::IsHeadersOnly() const
+{
+    return false;
+}
+
+bool Message::DumpToFile(MessageStore &store)
 {
-    std::ofstream file(outDirectoryPath + "/" + this->FileName);
-    file << this->MessageBody;
-    file.close();
+    return store.Write(this->MessageBody, this->FileName, this->IsHeadersOnly());
 }
@@ -0,0 +1,708 @@
+/**
+ * @file MessageStore.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of MessageStore, MaildirStore, ShardedStore, DedupStore and ArchiveStore class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/MessageStore.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <openssl/evp.h>
+#include <set>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "../include/Statistics.h"
+
+#define MAILDIR_INFO ":2," // Separates the unique name of a Maildir message from its flags
+#define MAILDIR_HEADERS_FLAG 'h'
+#define DIGEST_ATTRIBUTE "user.imapcl.sha256" // Extended attribute of deduplicated objects holding their digest
+
+MessageStore::MessageStore(const std::string &outDirectoryPath) : OutDirectoryPath(outDirectoryPath)
+{
+}
+
+MessageStore::~MessageStore() = default;
+
+std::unique_ptr<MessageStore> MessageStore::Create(Utils::StoreFormat format, const std::string &outDirectoryPath)
+{
+    if (format == Utils::STORE_MAILDIR)
+        return std::make_unique<MaildirStore>(outDirectoryPath);
+    if (format == Utils::STORE_SHARDED)
+        return std::make_unique<ShardedStore>(outDirectoryPath);
+    if (format == Utils::STORE_DEDUP)
+        return std::make_unique<DedupStore>(outDirectoryPath);
+    if (format == Utils::STORE_ARCHIVE)
+        return std::make_unique<ArchiveStore>(outDirectoryPath);
+    return std::make_unique<MessageStore>(outDirectoryPath);
+}
+
+Utils::ReturnCodes MessageStore::Prepare()
+{
+    return Utils::IMAPCL_SUCCESS;
+}
+
+std::string MessageStore::TemporaryFilePath(const std::string &name) const
+{
+    return this->OutDirectoryPath + "/." + name + ".part";
+}
+
+bool MessageStore::Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool)
+{
+    std::error_code error;
+    std::filesystem::rename(temporaryFilePath, this->OutDirectoryPath + "/" + fileName, error);
+    return !error;
+}
+
+std::string MessageStore::StreamFilePath(const std::string &temporaryFilePath, unsigned long, unsigned long &offset)
+{
+    offset = 0;
+    return temporaryFilePath;
+}
+
+bool MessageStore::DeliverStreamed(const std::string &filePath, unsigned long, unsigned long,
+                                   const std::string &fileName, bool headersOnly)
+{
+    return this->Deliver(filePath, fileName, headersOnly);
+}
+
+void MessageStore::Discard(const std::string &filePath, unsigned long, unsigned long)
+{
+    std::error_code error;
+    std::filesystem::remove(filePath, error);
+}
+
+bool MessageStore::Write(const std::string &body, const std::string &fileName, bool headersOnly)
+{
+    // Message appears in the store only once it is written completely
+    std::string temporaryFilePath = this->TemporaryFilePath(fileName);
+    std::ofstream file(temporaryFilePath, std::ios::binary | std::ios::trunc);
+    file << body;
+    file.close();
+    if (!file.good() || !this->Deliver(temporaryFilePath, fileName, headersOnly))
+    {
+        std::remove(temporaryFilePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void MessageStore::Remove(const std::filesystem::path &file)
+{
+    std::error_code error;
+    std::filesystem::remove_all(file, error);
+}
+
+bool MessageStore::Flush()
+{
+    return true;
+}
+
+std::vector<std::filesystem::path> MessageStore::ListMessageFiles() const
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry : std::filesystem::directory_iterator(this->OutDirectoryPath))
+        files.push_back(entry.path());
+    return files;
+}
+
+bool MessageStore::IsHeadersOnly(const std::string &fileName) const
+{
+    return fileName.length() >= 6 && !fileName.compare(fileName.length() - 6, 6, "_h.eml");
+}
+
+MaildirStore::MaildirStore(const std::string &outDirectoryPath) : MessageStore(outDirectoryPath)
+{
+}
+
+MaildirStore::~MaildirStore() = default;
+
+Utils::ReturnCodes MaildirStore::Prepare()
+{
+    std::error_code error;
+    for (const char *directory : {"/tmp", "/new", "/cur"})
+        if (!std::filesystem::create_directories(this->OutDirectoryPath + directory, error) && error)
+            return Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed creating Maildir in output directory");
+    return Utils::IMAPCL_SUCCESS;
+}
+
+std::string MaildirStore::SafeName(std::string name)
+{
+    // Subject in the name must neither start the info (i.e. 'Re: ...') nor a directory
+    std::replace(name.begin(), name.end(), ':', '_');
+    std::replace(name.begin(), name.end(), '/', '_');
+    return name;
+}
+
+std::string MaildirStore::TemporaryFilePath(const std::string &name) const
+{
+    return this->OutDirectoryPath + "/tmp/" + SafeName(name) + ".part";
+}
+
+bool MaildirStore::Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool headersOnly)
+{
+    // Extension of the file name is replaced by Maildir info
+    std::string suffix = headersOnly ? "_h.eml" : ".eml";
+    std::string uniqueName = fileName;
+    if (uniqueName.length() >= suffix.length() &&
+        !uniqueName.compare(uniqueName.length() - suffix.length(), suffix.length(), suffix))
+        uniqueName.erase(uniqueName.length() - suffix.length());
+    uniqueName = SafeName(uniqueName);
+    std::string info = MAILDIR_INFO;
+    if (headersOnly)
+        info += MAILDIR_HEADERS_FLAG;
+    std::error_code error;
+    std::filesystem::rename(temporaryFilePath, this->OutDirectoryPath + "/cur/" + uniqueName + info, error);
+    return !error;
+}
+
+std::vector<std::filesystem::path> MaildirStore::ListMessageFiles() const
+{
+    std::vector<std::filesystem::path> files;
+    for (const char *directory : {"/cur", "/new"})
+    {
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator(this->OutDirectoryPath + directory, error))
+            files.push_back(entry.path());
+    }
+    return files;
+}
+
+bool MaildirStore::IsHeadersOnly(const std::string &fileName) const
+{
+    std::size_t info = fileName.rfind(MAILDIR_INFO);
+    return info != std::string::npos && fileName.find(MAILDIR_HEADERS_FLAG, info) != std::string::npos;
+}
+
+ShardedStore::ShardedStore(const std::string &outDirectoryPath) : MessageStore(outDirectoryPath)
+{
+}
+
+ShardedStore::~ShardedStore() = default;
+
+std::string ShardedStore::ShardOf(const std::string &fileName)
+{
+    // Headers and the full message differ only in the suffix
+    std::size_t length = fileName.length();
+    if (length >= 6 && !fileName.compare(length - 6, 6, "_h.eml"))
+        length -= 6;
+    else if (length >= 4 && !fileName.compare(length - 4, 4, ".eml"))
+        length -= 4;
+    // FNV-1a, stable across builds unlike std::hash
+    uint32_t hash = 2166136261U;
+    for (std::size_t i = 0; i < length; i++)
+        hash = (hash ^ static_cast<unsigned char>(fileName[i])) * 16777619U;
+    char shard[3];
+    snprintf(shard, sizeof(shard), "%02x", hash % SHARD_FANOUT);
+    return shard;
+}
+
+Utils::ReturnCodes ShardedStore::Prepare()
+{
+    std::error_code error;
+    for (unsigned int i = 0; i < SHARD_FANOUT; i++)
+    {
+        char shard[4];
+        snprintf(shard, sizeof(shard), "/%02x", i);
+        if (!std::filesystem::create_directories(this->OutDirectoryPath + shard, error) && error)
+            return Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed creating shards in output directory");
+    }
+    return Utils::IMAPCL_SUCCESS;
+}
+
+bool ShardedStore::Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool)
+{
+    std::error_code error;
+    std::filesystem::rename(temporaryFilePath, this->OutDirectoryPath + "/" + ShardOf(fileName) + "/" + fileName,
+                            error);
+    return !error;
+}
+
+std::vector<std::filesystem::path> ShardedStore::ListMessageFiles() const
+{
+    std::vector<std::filesystem::path> files;
+    for (unsigned int i = 0; i < SHARD_FANOUT; i++)
+    {
+        char shard[4];
+        snprintf(shard, sizeof(shard), "/%02x", i);
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator(this->OutDirectoryPath + shard, error))
+            files.push_back(entry.path());
+    }
+    return files;
+}
+
+DedupStore::DedupStore(const std::string &outDirectoryPath) : MessageStore(outDirectoryPath)
+{
+}
+
+DedupStore::~DedupStore() = default;
+
+std::string DedupStore::Digest(std::istream &input)
+{
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    if (!context || !EVP_DigestInit_ex(context, EVP_sha256(), nullptr))
+    {
+        EVP_MD_CTX_free(context);
+        return "";
+    }
+    char buffer[65536];
+    while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0)
+        EVP_DigestUpdate(context, buffer, input.gcount());
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLength = 0;
+    bool digested = input.eof() && EVP_DigestFinal_ex(context, digest, &digestLength);
+    EVP_MD_CTX_free(context);
+    if (!digested)
+        return "";
+    std::string hex;
+    for (unsigned int i = 0; i < digestLength; i++)
+    {
+        char byte[3];
+        snprintf(byte, sizeof(byte), "%02x", digest[i]);
+        hex += byte;
+    }
+    return hex;
+}
+
+std::string DedupStore::ObjectFilePath(const std::string &digest) const
+{
+    return this->OutDirectoryPath + "/" OBJECTS_DIRECTORY "/" + digest.substr(0, 2) + "/" + digest;
+}
+
+Utils::ReturnCodes DedupStore::Prepare()
+{
+    std::error_code error;
+    for (unsigned int i = 0; i < SHARD_FANOUT; i++)
+    {
+        char shard[4];
+        snprintf(shard, sizeof(shard), "/%02x", i);
+        if (!std::filesystem::create_directories(this->OutDirectoryPath + "/" OBJECTS_DIRECTORY + shard, error) &&
+            error)
+            return Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed creating objects in output directory");
+    }
+    return Utils::IMAPCL_SUCCESS;
+}
+
+bool DedupStore::Link(const std::string &objectFilePath, const std::string &fileName) const
+{
+    // Link is created under a temporary name and renamed, so an existing message is replaced atomically
+    std::string temporaryFilePath = this->TemporaryFilePath(fileName);
+    std::error_code error;
+    std::filesystem::remove(temporaryFilePath, error);
+    std::filesystem::create_hard_link(objectFilePath, temporaryFilePath, error);
+    if (error)
+        return false;
+    std::filesystem::rename(temporaryFilePath, this->OutDirectoryPath + "/" + fileName, error);
+    if (!error)
+        return true;
+    std::filesystem::remove(temporaryFilePath, error);
+    return false;
+}
+
+bool DedupStore::Publish(const std::string &temporaryFilePath, const std::string &digest, unsigned long length,
+                         const std::string &fileName) const
+{
+    // Digest goes with the object, so removing a message finds its object without reading it
+    setxattr(temporaryFilePath.c_str(), DIGEST_ATTRIBUTE, digest.data(), digest.length(), 0);
+    // Linking fails if the object exists, so stores sharing the directory never replace each other's objects
+    std::string objectFilePath = this->ObjectFilePath(digest);
+    if (link(temporaryFilePath.c_str(), objectFilePath.c_str()) == -1)
+    {
+        if (errno != EEXIST)
+        {
+            std::remove(temporaryFilePath.c_str());
+            return false;
+        }
+        Statistics::Add(Statistics::DEDUPLICATED);
+        Statistics::Add(Statistics::DEDUPLICATED_BYTES, length);
+    }
+    std::remove(temporaryFilePath.c_str());
+    return this->Link(objectFilePath, fileName);
+}
+
+bool DedupStore::Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool)
+{
+    std::ifstream input(temporaryFilePath, std::ios::binary);
+    std::string digest = Digest(input);
+    input.close();
+    std::error_code error;
+    unsigned long length = std::filesystem::file_size(temporaryFilePath, error);
+    if (digest.empty() || error)
+        return false;
+    return this->Publish(temporaryFilePath, digest, length, fileName);
+}
+
+bool DedupStore::Write(const std::string &body, const std::string &fileName, bool)
+{
+    std::istringstream input(body);
+    std::string digest = Digest(input);
+    if (digest.empty())
+        return false;
+    // Body already stored is not written again, unless its object is removed in the meantime
+    if (this->Link(this->ObjectFilePath(digest), fileName))
+    {
+        Statistics::Add(Statistics::DEDUPLICATED);
+        Statistics::Add(Statistics::DEDUPLICATED_BYTES, body.length());
+        return true;
+    }
+    std::string temporaryFilePath = this->TemporaryFilePath(fileName);
+    std::ofstream file(temporaryFilePath, std::ios::binary | std::ios::trunc);
+    file << body;
+    file.close();
+    if (!file.good())
+    {
+        std::remove(temporaryFilePath.c_str());
+        return false;
+    }
+    return this->Publish(temporaryFilePath, digest, body.length(), fileName);
+}
+
+void DedupStore::Remove(const std::filesystem::path &file)
+{
+    // Object linked only by the removed message is removed too
+    struct stat status;
+    if (lstat(file.c_str(), &status) == 0 && S_ISREG(status.st_mode) && status.st_nlink == 2)
+    {
+        char attribute[64];
+        ssize_t attributeLength = getxattr(file.c_str(), DIGEST_ATTRIBUTE, attribute, sizeof(attribute));
+        std::string digest;
+        if (attributeLength == sizeof(attribute))
+            digest.assign(attribute, sizeof(attribute));
+        else
+        {
+            // File system without extended attributes, the message is hashed
+            std::ifstream input(file, std::ios::binary);
+            digest = Digest(input);
+        }
+        // Object is removed only if it is the other link of the message
+        struct stat objectStatus;
+        std::string objectFilePath = this->ObjectFilePath(digest);
+        if (!digest.empty() && stat(objectFilePath.c_str(), &objectStatus) == 0 &&
+            objectStatus.st_ino == status.st_ino && objectStatus.st_dev == status.st_dev)
+            std::remove(objectFilePath.c_str());
+    }
+    MessageStore::Remove(file);
+}
+
+ArchiveStore::ArchiveStore(const std::string &outDirectoryPath, unsigned long segmentBytes)
+    : MessageStore(outDirectoryPath), SegmentBytes(segmentBytes), CurrentSegment(1), SegmentDescriptor(-1),
+      SegmentEnd(0), IndexDescriptor(-1)
+{
+}
+
+ArchiveStore::~ArchiveStore()
+{
+    this->Flush();
+    if (this->SegmentDescriptor >= 0)
+        close(this->SegmentDescriptor);
+    if (this->IndexDescriptor >= 0)
+        close(this->IndexDescriptor);
+}
+
+std::string ArchiveStore::SegmentFilePath(unsigned int segment) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/segment-%06u", segment);
+    return this->OutDirectoryPath + "/" ARCHIVE_DIRECTORY + name;
+}
+
+unsigned int ArchiveStore::SegmentOf(const std::string &filePath) const
+{
+    std::string prefix = this->OutDirectoryPath + "/" ARCHIVE_DIRECTORY "/segment-";
+    if (filePath.compare(0, prefix.length(), prefix))
+        return 0;
+    return std::strtoul(filePath.c_str() + prefix.length(), nullptr, 10);
+}
+
+bool ArchiveStore::Lock()
+{
+    if (this->IndexDescriptor < 0)
+    {
+        std::string indexFilePath = this->OutDirectoryPath + "/" ARCHIVE_DIRECTORY "/index";
+        this->IndexDescriptor = open(indexFilePath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (this->IndexDescriptor < 0)
+            return false;
+    }
+    return flock(this->IndexDescriptor, LOCK_EX) == 0;
+}
+
+void ArchiveStore::Unlock()
+{
+    flock(this->IndexDescriptor, LOCK_UN);
+}
+
+Utils::ReturnCodes ArchiveStore::Prepare()
+{
+    std::error_code error;
+    if (!std::filesystem::create_directories(this->OutDirectoryPath + "/" ARCHIVE_DIRECTORY, error) && error)
+        return Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed creating archive in output directory");
+    return Utils::IMAPCL_SUCCESS;
+}
+
+bool ArchiveStore::Claim(unsigned long length)
+{
+    if (this->SegmentDescriptor >= 0)
+    {
+        if (this->SegmentEnd == 0 || this->SegmentEnd + length <= this->SegmentBytes)
+            return true;
+        close(this->SegmentDescriptor);
+        this->SegmentDescriptor = -1;
+        this->CurrentSegment++;
+    }
+    // Earlier segments are full or were left by stores that are done with them
+    std::error_code error;
+    while (std::filesystem::exists(this->SegmentFilePath(this->CurrentSegment + 1), error))
+        this->CurrentSegment++;
+    while (true)
+    {
+        std::string segmentFilePath = this->SegmentFilePath(this->CurrentSegment);
+        int descriptor = open(segmentFilePath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (descriptor < 0)
+            return false;
+        // Segment written by another store, or one without room for the message, is left for the next one
+        struct stat status;
+        if (flock(descriptor, LOCK_EX | LOCK_NB) == 0 && fstat(descriptor, &status) == 0 &&
+            (status.st_size == 0 || static_cast<unsigned long>(status.st_size) + length <= this->SegmentBytes))
+        {
+            this->SegmentDescriptor = descriptor;
+            this->SegmentEnd = status.st_size;
+            return true;
+        }
+        close(descriptor);
+        this->CurrentSegment++;
+    }
+}
+
+void ArchiveStore::Record(unsigned int segment, unsigned long offset, unsigned long length,
+                          const std::string &fileName, bool headersOnly)
+{
+    this->PendingRecords += fileName.substr(0, fileName.find('_')) + " " + std::to_string(segment) + " " +
+                            std::to_string(offset) + " " + std::to_string(length) + " " +
+                            (headersOnly ? "H " : "F ") + fileName + "\n";
+    if (this->PendingRecords.length() > ARCHIVE_PENDING_SIZE)
+        this->Flush();
+}
+
+bool ArchiveStore::Append(std::istream &input, const std::string &fileName, bool headersOnly)
+{
+    input.seekg(0, std::ios::end);
+    unsigned long length = static_cast<unsigned long>(input.tellg());
+    input.seekg(0, std::ios::beg);
+    if (!this->Claim(length))
+        return false;
+
+    unsigned long offset = this->SegmentEnd;
+    char buffer[LITERAL_CHUNK_SIZE];
+    unsigned long written = 0;
+    while (written < length)
+    {
+        input.read(buffer, std::min<unsigned long>(sizeof(buffer), length - written));
+        ssize_t chunk = input.gcount() > 0 ? pwrite(this->SegmentDescriptor, buffer, input.gcount(), offset + written)
+                                           : -1;
+        if (chunk <= 0)
+        {
+            // Partly appended message is cut off, so the next message starts right after the last one
+            if (ftruncate(this->SegmentDescriptor, offset) == -1)
+                this->SegmentEnd = offset + written;
+            return false;
+        }
+        written += chunk;
+    }
+    this->SegmentEnd = offset + length;
+    this->Record(this->CurrentSegment, offset, length, fileName, headersOnly);
+    return true;
+}
+
+bool ArchiveStore::Deliver(const std::string &temporaryFilePath, const std::string &fileName, bool headersOnly)
+{
+    // Only bodies that could not be written in place (i.e. resumed downloads) are copied from a temporary file
+    std::ifstream input(temporaryFilePath, std::ios::binary);
+    if (!input.is_open())
+        return false;
+    bool appended = this->Append(input, fileName, headersOnly);
+    input.close();
+    if (appended)
+        std::remove(temporaryFilePath.c_str());
+    return appended;
+}
+
+std::string ArchiveStore::StreamFilePath(const std::string &temporaryFilePath, unsigned long length,
+                                         unsigned long &offset)
+{
+    if (!this->Claim(length))
+        return MessageStore::StreamFilePath(temporaryFilePath, length, offset);
+    // Space of the body is reserved, so bodies received one after another do not wait for each other to be delivered
+    offset = this->SegmentEnd;
+    this->SegmentEnd += length;
+    return this->SegmentFilePath(this->CurrentSegment);
+}
+
+bool ArchiveStore::DeliverStreamed(const std::string &filePath, unsigned long offset, unsigned long length,
+                                   const std::string &fileName, bool headersOnly)
+{
+    unsigned int segment = this->SegmentOf(filePath);
+    if (!segment)
+        return this->Deliver(filePath, fileName, headersOnly);
+    this->Record(segment, offset, length, fileName, headersOnly);
+    return true;
+}
+
+void ArchiveStore::Discard(const std::string &filePath, unsigned long offset, unsigned long length)
+{
+    unsigned int segment = this->SegmentOf(filePath);
+    if (!segment)
+        return MessageStore::Discard(filePath, offset, length);
+    // Body given up at the end of the claimed segment is cut off, otherwise its space is left unused
+    if (segment == this->CurrentSegment && this->SegmentDescriptor >= 0 && offset + length == this->SegmentEnd &&
+        ftruncate(this->SegmentDescriptor, offset) == 0)
+        this->SegmentEnd = offset;
+}
+
+bool ArchiveStore::Write(const std::string &body, const std::string &fileName, bool headersOnly)
+{
+    // Message is appended from memory, no temporary file is needed
+    std::istringstream input(body);
+    return this->Append(input, fileName, headersOnly);
+}
+
+void ArchiveStore::Remove(const std::filesystem::path &file)
+{
+    this->PendingRecords += "- " + file.filename().string() + "\n";
+}
+
+bool ArchiveStore::Flush()
+{
+    if (this->PendingRecords.empty())
+        return true;
+    if (!this->Lock())
+        return false;
+    // Records of the batch are appended by a single write, so they are not interleaved with records of other stores
+    ssize_t written = write(this->IndexDescriptor, this->PendingRecords.data(), this->PendingRecords.length());
+    this->Unlock();
+    if (written != static_cast<ssize_t>(this->PendingRecords.length()))
+        return false;
+    this->PendingRecords.clear();
+    return true;
+}
+
+std::string ArchiveStore::ReadIndex() const
+{
+    std::ifstream file(this->OutDirectoryPath + "/" ARCHIVE_DIRECTORY "/index", std::ios::binary);
+    std::stringstream records;
+    if (file.is_open())
+        records << file.rdbuf();
+    return records.str() + this->PendingRecords;
+}
+
+std::vector<ArchiveStore::ArchivedMessage> ArchiveStore::ParseIndex(const std::string &records)
+{
+    std::map<std::string, ArchivedMessage> messages;
+    std::size_t start = 0, end;
+    // Unterminated last line was torn by an interrupted write, it is ignored
+    while ((end = records.find('\n', start)) != std::string::npos)
+    {
+        std::istringstream line(records.substr(start, end - start));
+        start = end + 1;
+        std::string uid, fileName;
+        char flag;
+        ArchivedMessage message;
+        if (!(line >> uid))
+            continue;
+        // File name is the rest of the line after the fixed fields, it may contain whitespace
+        if (uid == "-")
+        {
+            if (line.get() == ' ' && std::getline(line, fileName) && !fileName.empty())
+                messages.erase(fileName);
+            continue;
+        }
+        if (!(line >> message.Segment >> message.Offset >> message.Length >> flag) || line.get() != ' ' ||
+            !std::getline(line, message.FileName) || message.FileName.empty())
+            continue;
+        messages[message.FileName] = message;
+    }
+    std::vector<ArchivedMessage> result;
+    result.reserve(messages.size());
+    for (auto &entry : messages)
+        result.push_back(std::move(entry.second));
+    return result;
+}
+
+std::vector<std::filesystem::path> ArchiveStore::ListMessageFiles() const
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto &message : ParseIndex(this->ReadIndex()))
+        files.push_back(this->OutDirectoryPath + "/" + message.FileName);
+    return files;
+}
+
+Utils::ReturnCodes ArchiveStore::Extract(const std::vector<std::string> &names,
+                                         const std::string &outDirectoryPath) const
+{
+    std::error_code error;
+    if (!std::filesystem::exists(this->OutDirectoryPath + "/" ARCHIVE_DIRECTORY "/index", error))
+        return Utils::PrintError(Utils::ARCHIVE_NOT_FOUND, "Archive not found in " + this->OutDirectoryPath);
+    std::vector<ArchivedMessage> messages = ParseIndex(this->ReadIndex());
+
+    Utils::ReturnCodes returnCode = Utils::IMAPCL_SUCCESS;
+    std::vector<const ArchivedMessage *> selected;
+    if (names.empty())
+        for (const auto &message : messages)
+            selected.push_back(&message);
+    for (const auto &name : names)
+    {
+        // Name is a file name or its beginning ('<UID>', '<UID>_<Mailbox>' or '<UID>_<Mailbox>_<Hostname>'), which
+        // selects both the full message and its headers
+        std::vector<const ArchivedMessage *> matches;
+        std::set<std::string> messageNames;
+        for (const auto &message : messages)
+            if (message.FileName == name || !message.FileName.compare(0, name.length() + 1, name + "_"))
+            {
+                matches.push_back(&message);
+                messageNames.insert(this->IsHeadersOnly(message.FileName)
+                                        ? message.FileName.substr(0, message.FileName.length() - 6) + ".eml"
+                                        : message.FileName);
+            }
+        if (matches.empty())
+            returnCode = Utils::PrintError(Utils::ARCHIVE_NOT_FOUND, "Message " + name + " not found in archive");
+        // The same UID is found in every mailbox, a name that selects several messages is not guessed at
+        else if (messageNames.size() > 1)
+            returnCode = Utils::PrintError(Utils::ARCHIVE_AMBIGUOUS_NAME,
+                                           "Message " + name + " is archived from several mailboxes, give it as " +
+                                               "<UID>_<Mailbox>_<Hostname>");
+        else
+            selected.insert(selected.end(), matches.begin(), matches.end());
+    }
+
+    for (const auto *message : selected)
+    {
+        std::ifstream segment(this->SegmentFilePath(message->Segment), std::ios::binary);
+        std::string body(message->Length, '\0');
+        segment.seekg(message->Offset);
+        segment.read(body.data(), body.length());
+        if (!segment.good())
+        {
+            returnCode = Utils::PrintError(Utils::ARCHIVE_NOT_FOUND, "Message " + message->FileName + " is truncated");
+            continue;
+        }
+        std::ofstream file(outDirectoryPath + "/" + message->FileName, std::ios::binary | std::ios::trunc);
+        file << body;
+        file.close();
+        if (!file.good())
+            returnCode = Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed writing " + message->FileName);
+    }
+    return returnCode;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file ResponseParser.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of ResponseParser class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/ResponseParser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+
+ResponseParser::ResponseParser()
+    : Line(""), Tag(""), Status(STATUS_NONE), LiteralRemaining(0), LiteralSize(0), LineReady(false),
+      ResponseComplete(false), FirstFragment(true), Malformed(false)
+{
+}
+
+ResponseParser::~ResponseParser() = default;
+
+void ResponseParser::Reset()
+{
+    this->Line.clear();
+    this->Tag.clear();
+    this->Status = STATUS_NONE;
+    this->LiteralRemaining = 0;
+    this->LiteralSize = 0;
+    this->LineReady = false;
+    this->ResponseComplete = false;
+    this->FirstFragment = true;
+    this->Malformed = false;
+}
+
+void ResponseParser::FinishFragment()
+{
+    if (!this->Line.empty() && this->Line.back() == '\r')
+        this->Line.pop_back();
+    this->LineReady = true;
+    if (this->FirstFragment)
+    {
+        // First fragment of a response carries its tag and status
+        this->FirstFragment = false;
+        std::size_t tagEnd = this->Line.find(' ');
+        this->Tag = this->Line.substr(0, tagEnd);
+        this->Status = STATUS_NONE;
+        if (tagEnd != std::string::npos)
+        {
+            std::size_t statusEnd = this->Line.find(' ', tagEnd + 1);
+            std::string status = this->Line.substr(tagEnd + 1, statusEnd - tagEnd - 1);
+            std::transform(status.begin(), status.end(), status.begin(), ::toupper);
+            if (status == "OK")
+                this->Status = STATUS_OK;
+            else if (status == "NO")
+                this->Status = STATUS_NO;
+            else if (status == "BAD")
+                this->Status = STATUS_BAD;
+            else if (status == "PREAUTH")
+                this->Status = STATUS_PREAUTH;
+            else if (status == "BYE")
+                this->Status = STATUS_BYE;
+        }
+    }
+    // Checking whether the fragment announces a literal ('{N}' or '{N+}' at the end of the line)
+    this->ResponseComplete = !this->Malformed;
+    if (this->Malformed || this->Line.empty() || this->Line.back() != '}')
+        return;
+    std::size_t literalStart = this->Line.rfind('{');
+    if (literalStart == std::string::npos)
+        return;
+    std::size_t digitsEnd = this->Line.length() - 1;
+    if (this->Line[digitsEnd - 1] == '+')
+        digitsEnd--;
+    if (digitsEnd == literalStart + 1)
+        return;
+    unsigned long literalSize = 0;
+    bool overflow = false;
+    for (std::size_t i = literalStart + 1; i < digitsEnd; i++)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(this->Line[i])))
+            return;
+        unsigned long digit = this->Line[i] - '0';
+        if (literalSize > (ULONG_MAX - digit) / 10)
+            overflow = true;
+        else
+            literalSize = literalSize * 10 + digit;
+    }
+    if (overflow)
+    {
+        // Bytes of the literal can not be counted, so nothing after this line is treated as complete
+        this->Malformed = true;
+        this->ResponseComplete = false;
+        return;
+    }
+    this->LiteralSize = literalSize;
+    this->LiteralRemaining = literalSize;
+    this->ResponseComplete = false;
+}
+
+void ResponseParser::StartFeed()
+{
+    if (!this->LineReady)
+        return;
+    // Previous call finished a fragment, so a new one starts here
+    this->Line.clear();
+    this->LineReady = false;
+    this->LiteralSize = 0;
+    if (this->ResponseComplete)
+    {
+        this->ResponseComplete = false;
+        this->FirstFragment = true;
+    }
+}
+
+std::size_t ResponseParser::Feed(const char *data, std::size_t length)
+{
+    this->StartFeed();
+    if (this->LiteralRemaining > 0)
+    {
+        std::size_t consumed = std::min<unsigned long>(this->LiteralRemaining, length);
+        this->LiteralRemaining -= consumed;
+        return consumed;
+    }
+    const char *lineEnd = static_cast<const char *>(std::memchr(data, '\n', length));
+    if (lineEnd == nullptr)
+    {
+        this->Line.append(data, length);
+        return length;
+    }
+    std::size_t consumed = lineEnd - data + 1;
+    this->Line.append(data, consumed - 1);
+    this->FinishFragment();
+    return consumed;
+}
+
+std::size_t ResponseParser::SkipLiteral(std::size_t length)
+{
+    this->StartFeed();
+    std::size_t skipped = std::min<unsigned long>(this->LiteralRemaining, length);
+    this->LiteralRemaining -= skipped;
+    return skipped;
+}
+
+bool ResponseParser::InLiteral() const
+{
+    return this->LiteralRemaining > 0;
+}
+
+unsigned long ResponseParser::GetLiteralRemaining() const
+{
+    return this->LiteralRemaining;
+}
+
+unsigned long ResponseParser::GetLiteralSize() const
+{
+    return this->LiteralSize;
+}
+
+bool ResponseParser::IsLineReady() const
+{
+    return this->LineReady;
+}
+
+const std::string &ResponseParser::GetLine() const
+{
+    return this->Line;
+}
+
+bool ResponseParser::IsResponseComplete() const
+{
+    return this->ResponseComplete;
+}
+
+bool ResponseParser::IsTagged() const
+{
+    return this->Tag != "*" && this->Tag != "+";
+}
+
+const std::string &ResponseParser::GetTag() const
+{
+    return this->Tag;
+}
+
+ResponseParser::ResponseStatus ResponseParser::GetStatus() const
+{
+    return this->Status;
+}
+
+bool ResponseParser::IsMalformed() const
+{
+    return this->Malformed;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file SecureContextFactory.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of SecureContextFactory class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/SecureContextFactory.h"
+#include "../include/EncryptedSession.h"
+
+std::map<std::string, SSL_CTX *> SecureContextFactory::Contexts;
+std::mutex SecureContextFactory::ContextsMutex;
+std::once_flag SecureContextFactory::Initialized;
+
+Utils::ReturnCodes SecureContextFactory::Acquire(const std::string &certificateFile,
+                                                 const std::string &certificateFileDirectoryPath,
+                                                 SSL_CTX *&secureContext)
+{
+    std::call_once(Initialized, []() {
+        OPENSSL_init_ssl(OPENSSL_INIT_LOAD_SSL_STRINGS | OPENSSL_INIT_LOAD_CRYPTO_STRINGS, nullptr);
+    });
+    std::string key = certificateFile + "\n" + certificateFileDirectoryPath;
+    // Certificates are loaded while holding the lock, so sessions starting at once do not load them twice
+    std::lock_guard<std::mutex> lock(ContextsMutex);
+    auto cached = Contexts.find(key);
+    if (cached != Contexts.end())
+    {
+        SSL_CTX_up_ref(cached->second);
+        secureContext = cached->second;
+        return Utils::IMAPCL_SUCCESS;
+    }
+    // Creating SSL context
+    SSL_CTX *createdContext;
+    if ((createdContext = SSL_CTX_new(TLS_client_method())) == nullptr)
+        return Utils::PrintError(Utils::SSL_CONTEXT_CREATE, "Failed creating SSL context");
+    // Verifying certificate file
+    if (certificateFile != "")
+        if (!SSL_CTX_load_verify_file(createdContext, certificateFile.c_str()))
+        {
+            SSL_CTX_free(createdContext);
+            return Utils::PrintError(Utils::CERTIFICATE_ERROR, "Certificate file error");
+        }
+    // Verifying certificate directory
+    if (!SSL_CTX_load_verify_dir(createdContext, certificateFileDirectoryPath.c_str()))
+    {
+        SSL_CTX_free(createdContext);
+        return Utils::PrintError(Utils::CERTIFICATE_ERROR, "Certificate directory error");
+    }
+    SSL_CTX_set_verify(createdContext, SSL_VERIFY_PEER, nullptr);
+    // Sessions are kept only in the cache files, the new session callback is not called without the client cache
+    SSL_CTX_set_session_cache_mode(createdContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(createdContext, EncryptedSession::StoreSession);
+    // Cache keeps its own reference for the whole run
+    Contexts[key] = createdContext;
+    SSL_CTX_up_ref(createdContext);
+    secureContext = createdContext;
+    return Utils::IMAPCL_SUCCESS;
+}
@@ -8,33 +8,48 @@
  * @copyright Copyright (c) 2024
  *
  */
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <cstdlib>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <regex>
+#include <sstream>
 #include <string>
 #include <sys/socket.h>
+#include <thread>
 
+#include "../include/ConnectionRace.h"
 #include "../include/HeaderMessage.h"
 #include "../include/Message.h"
 #include "../include/Session.h"
+#include "../include/Statistics.h"
+#include "../include/StreamedMessage.h"
 
 Session::Session()
 {
 }
 
 Session::Session(const std::string &serverHostname, const std::string &port, const std::string &username,
-                 const std::string &password, const std::string &outDirectoryPath, const std::string &mailBox)
+                 const std::string &password, const std::string &outDirectoryPath, const std::string &mailBox,
+                 const Utils::SessionOptions &options)
     : SocketDescriptor(-1), Server(nullptr), ServerHostname(serverHostname), Port(port), Username(username),
-      Password(password), Buffer(std::string("", BUFFER_SIZE)), FullResponse(""), OutDirectoryPath(outDirectoryPath),
-      MailBox(mailBox), CurrentTagNumber(1), ReturnCode(Utils::IMAPCL_SUCCESS)
+      Password(password), Buffer(std::string(BUFFER_SIZE, '\0')), BufferStart(0), BufferEnd(0), FullResponse(""),
+      LiteralBuffer(std::string(LITERAL_CHUNK_SIZE, '\0')), OutDirectoryPath(outDirectoryPath), MailBox(mailBox),
+      MailBoxFileName(Utils::MailboxFileName(mailBox)), CurrentTagNumber(1), ReturnCode(Utils::IMAPCL_SUCCESS),
+      Options(options), TemporaryFileCounter(0), WorkerNumber(0), Compression(nullptr), CompressedBuffer(""),
+      UidNext(1), MailBoxValidity(""), StoredValidity(""), StoredModSeq(0), StoredUidNext(0),
+      StoredHeadersOnly(false),
+      HighestModSeq(0), QresyncEnabled(false), QresyncSelected(false), ChunkedMessage(nullptr), ChunkLength(0),
+      ChunkArrived(false),
+      Progress({"", "", 0, {}, 0}), Index(nullptr), Store(MessageStore::Create(options.Store, outDirectoryPath))
 {
 }
 
 Session::~Session()
 {
-    if (this->Server != nullptr)
-        freeaddrinfo(this->Server);
     if (this->SocketDescriptor > 0)
     {
         shutdown(this->SocketDescriptor, SHUT_RDWR);
@@ -42,67 +57,654 @@ Session::~Session()
     }
 }
 
+const Session::SyncProgress &Session::GetProgress() const
+{
+    return this->Progress;
+}
+
+void Session::ResumeProgress(const SyncProgress &progress)
+{
+    this->Progress = progress;
+}
+
 Utils::ReturnCodes Session::GetHostAddressInfo()
 {
     struct addrinfo hints = {};
-    hints.ai_family = AF_INET;
+    // Addresses of both families are raced by ConnectSocket
+    hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_protocol = IPPROTO_TCP;
-    if (getaddrinfo(this->ServerHostname.c_str(), this->Port.c_str(), &hints, &(this->Server)) != 0)
+    if ((this->Server = HostResolver::Resolve(this->ServerHostname, this->Port, hints)) == nullptr)
         return Utils::PrintError(Utils::SERVER_BAD_HOST, "Bad host");
     return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes Session::CreateSocket()
+std::chrono::steady_clock::time_point Session::OperationDeadline() const
 {
-    if ((this->SocketDescriptor =
-             socket(this->Server->ai_family, this->Server->ai_socktype, this->Server->ai_protocol)) <= 0)
+    return std::chrono::steady_clock::now() + std::chrono::seconds(this->Options.Timeout);
+}
+
+bool Session::WaitForSocket(bool write, std::chrono::steady_clock::time_point deadline)
+{
+    switch (this->Waiter.Wait(write, deadline))
+    {
+    case SocketWaiter::WAIT_READY:
+        return true;
+    case SocketWaiter::WAIT_TIMED_OUT:
+        errno = EAGAIN;
+        return false;
+    default:
+        errno = EIO;
+        return false;
+    }
+}
+
+Utils::ReturnCodes Session::ConnectSocket()
+{
+    unsigned int timeout = this->Options.ConnectTimeout ? this->Options.ConnectTimeout : this->Options.Timeout;
+    ConnectionRace race(this->Server.get());
+    if ((this->SocketDescriptor = race.Connect(std::chrono::milliseconds(CONNECTION_ATTEMPT_DELAY),
+                                               std::chrono::steady_clock::now() + std::chrono::seconds(timeout))) < 0)
+        return Utils::PrintError(Utils::SOCKET_CONNECTING, "Connecting to socket failed");
+    // Socket operations wait for readiness with a deadline instead of blocking
+    if (!this->Waiter.Watch(this->SocketDescriptor))
         return Utils::PrintError(Utils::SOCKET_CREATING, "Error creating socket");
-    // https://stackoverflow.com/questions/2876024/linux-is-there-a-read-or-recv-from-socket-with-timeout
-    struct timeval timeout = {10, 0};
-    setsockopt(this->SocketDescriptor, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(struct timeval));
     return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes Session::ReceiveUntaggedResponse()
+long Session::ReceiveData(char *data, std::size_t length)
+{
+    auto deadline = this->OperationDeadline();
+    while (true)
+    {
+        long received = recv(this->SocketDescriptor, data, length, 0);
+        if (received >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return received;
+        if (!this->WaitForSocket(false, deadline))
+            return -1;
+    }
+}
+
+long Session::SendData(const char *data, std::size_t length)
+{
+    auto deadline = this->OperationDeadline();
+    std::size_t sent = 0;
+    while (sent < length)
+    {
+        long result = send(this->SocketDescriptor, data + sent, length - sent, MSG_NOSIGNAL);
+        if (result > 0)
+        {
+            sent += result;
+            continue;
+        }
+        if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return -1;
+        if (!this->WaitForSocket(true, deadline))
+            return -1;
+    }
+    return sent;
+}
+
+long Session::Receive(char *data, std::size_t length)
 {
+    if (!this->Compression)
+        return this->ReceiveData(data, length);
     while (true)
     {
-        unsigned long int received = recv(this->SocketDescriptor, this->Buffer.data(), BUFFER_SIZE, 0);
+        long inflated = this->Compression->Inflate(data, length);
+        if (inflated > 0)
+        {
+            Statistics::Add(Statistics::DECOMPRESSED_BYTES, inflated);
+            return inflated;
+        }
+        if (inflated < 0)
+        {
+            errno = EIO;
+            return -1;
+        }
+        // Compressed data is read only after all of the previous data was inflated, so the buffer can be reused
+        long received = this->ReceiveData(this->CompressedBuffer.data(), this->CompressedBuffer.length());
+        if (received <= 0)
+            return received;
+        Statistics::Add(Statistics::COMPRESSED_BYTES, received);
+        this->Compression->SetInput(this->CompressedBuffer.data(), received);
+    }
+}
+
+long Session::Send(const char *data, std::size_t length)
+{
+    if (!this->Compression)
+        return this->SendData(data, length);
+    std::string compressed;
+    if (!this->Compression->Deflate(data, length, compressed))
+    {
+        errno = EIO;
+        return -1;
+    }
+    if (this->SendData(compressed.data(), compressed.length()) <= 0)
+        return -1;
+    return length;
+}
+
+Utils::ReturnCodes Session::FillBuffer()
+{
+    if (this->Parser.IsMalformed())
+        return Utils::PrintError(Utils::INVALID_RESPONSE, "Server announced a literal that is too large");
+    if (this->BufferStart < this->BufferEnd)
+        return Utils::IMAPCL_SUCCESS;
+    long received = this->Receive(this->Buffer.data(), BUFFER_SIZE);
+    if (received < 0)
+    {
         if (errno == EAGAIN || errno == EWOULDBLOCK)
             return Utils::PrintError(Utils::SOCKET_TIMED_OUT, "Timed out");
-        if (received != 0)
+        return Utils::PrintError(Utils::SOCKET_READING, "Failed reading from a socket");
+    }
+    if (received == 0)
+        return Utils::PrintError(Utils::CONNECTION_CLOSED, "Connection closed by the server");
+    this->BufferStart = 0;
+    this->BufferEnd = received;
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes Session::ReceiveLiteral(StreamedMessage &body, std::size_t length)
+{
+    long received = this->Receive(this->LiteralBuffer.data(), length);
+    if (received < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return Utils::PrintError(Utils::SOCKET_TIMED_OUT, "Timed out");
+        return Utils::PrintError(Utils::SOCKET_READING, "Failed reading from a socket");
+    }
+    if (received == 0)
+        return Utils::PrintError(Utils::CONNECTION_CLOSED, "Connection closed by the server");
+    this->Parser.Feed(this->LiteralBuffer.data(), received);
+    if (!body.Write(this->LiteralBuffer.data(), received))
+        return Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed writing message file");
+    return Utils::IMAPCL_SUCCESS;
+}
+
+bool Session::HasPendingData()
+{
+    return this->BufferStart < this->BufferEnd || (this->Compression && this->Compression->HasPending());
+}
+
+Utils::ReturnCodes Session::ReceiveResponse()
+{
+    while (true)
+    {
+        if ((this->ReturnCode = this->FillBuffer()))
+            return this->ReturnCode;
+        const char *data = this->Buffer.data() + this->BufferStart;
+        std::size_t consumed = this->Parser.Feed(data, this->BufferEnd - this->BufferStart);
+        this->FullResponse.append(data, consumed);
+        this->BufferStart += consumed;
+        if (this->Parser.IsResponseComplete())
+            return Utils::IMAPCL_SUCCESS;
+    }
+}
+
+Utils::ReturnCodes Session::ReceiveUntaggedResponse()
+{
+    while (true)
+    {
+        if ((this->ReturnCode = this->FillBuffer()))
+            return this->ReturnCode;
+        const char *data = this->Buffer.data() + this->BufferStart;
+        std::size_t consumed = this->Parser.Feed(data, this->BufferEnd - this->BufferStart);
+        this->FullResponse.append(data, consumed);
+        this->BufferStart += consumed;
+        // Keep listening on the port until '*' + OK/NO/BAD is present, so we can stop reading
+        if (this->Parser.IsResponseComplete() && !this->Parser.IsTagged() &&
+            this->Parser.GetStatus() != ResponseParser::STATUS_NONE)
+            break;
+    }
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes Session::ReceiveTaggedResponse()
+{
+    std::string tag = "A" + std::to_string(this->CurrentTagNumber);
+    while (true)
+    {
+        if ((this->ReturnCode = this->FillBuffer()))
+            return this->ReturnCode;
+        const char *data = this->Buffer.data() + this->BufferStart;
+        std::size_t consumed = this->Parser.Feed(data, this->BufferEnd - this->BufferStart);
+        this->FullResponse.append(data, consumed);
+        this->BufferStart += consumed;
+        // Keep listening on the port until 'current tag' + OK/NO/BAD is present, so we can stop reading
+        if (this->Parser.IsResponseComplete() && this->Parser.IsTagged() && this->Parser.GetTag() == tag)
+            break;
+    }
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes Session::ReceiveFetchResponses(std::string &completedTag)
+{
+    std::string responseUID = "";
+    std::string responseSize = "";
+    std::string responseText = "";
+    std::unique_ptr<StreamedMessage> body;
+    StreamedMessage *bodyTarget = nullptr; // Message the body literal is written to
+    bool bodyLiteral = false;
+    bool headerLiteral = false;
+    while (true)
+    {
+        if (bodyLiteral && this->Parser.InLiteral() && this->BufferStart == this->BufferEnd)
+        {
+            // Reading the body literal directly, never past its end, so no other response is mixed into it
+            std::size_t length = std::min<unsigned long>(this->Parser.GetLiteralRemaining(), LITERAL_CHUNK_SIZE);
+            if ((this->ReturnCode = this->ReceiveLiteral(*bodyTarget, length)))
+                return this->ReturnCode;
+            continue;
+        }
+        if ((this->ReturnCode = this->FillBuffer()))
+            return this->ReturnCode;
+        const char *data = this->Buffer.data() + this->BufferStart;
+        bool literal = this->Parser.InLiteral();
+        std::size_t consumed = this->Parser.Feed(data, this->BufferEnd - this->BufferStart);
+        this->BufferStart += consumed;
+        if (literal && bodyLiteral)
+        {
+            if (!bodyTarget->Write(data, consumed))
+                return Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed writing message file");
+            continue;
+        }
+        // Header literals are small, they are kept with the rest of the response
+        responseText.append(data, consumed);
+        if (literal || !this->Parser.IsLineReady())
+            continue;
+        const std::string &line = this->Parser.GetLine();
+        if (responseUID.empty())
+            responseUID = Utils::ExtractFetchItem(line, "UID");
+        if (responseSize.empty())
+            responseSize = Utils::ExtractFetchItem(line, "RFC822.SIZE");
+        // Fragment ending a line that leaves the response incomplete announced a literal, which can be empty
+        // (i.e. the last chunk of a message whose size is a multiple of the chunk size)
+        if (!this->Parser.IsResponseComplete())
+        {
+            std::string item = Utils::ExtractLiteralItem(line);
+            // Chunk of a message fetched in parts is announced with its offset (i.e. 'BODY[]<1048576>')
+            bodyLiteral = !strcasecmp(item.c_str(), "BODY[]") || !strncasecmp(item.c_str(), "BODY[]<", 7);
+            headerLiteral = !strcasecmp(item.c_str(), "BODY[HEADER]");
+            if (bodyLiteral && this->ChunkedMessage)
+            {
+                this->ChunkLength = this->Parser.GetLiteralSize();
+                this->ChunkArrived = true;
+                bodyTarget = this->ChunkedMessage.get();
+            }
+            else if (bodyLiteral)
+            {
+                // UID usually precedes the literal, but servers are free to send it after the body
+                std::string temporaryFileName = responseUID;
+                if (temporaryFileName.empty())
+                    temporaryFileName = "pending" + std::to_string(this->WorkerNumber) + "_" +
+                                        std::to_string(this->TemporaryFileCounter++);
+                // Size of the message is the length of the literal, no separate RFC822.SIZE request is needed
+                body = std::make_unique<StreamedMessage>(responseUID, *this->Store,
+                                                         this->PartialFilePath(temporaryFileName),
+                                                         this->Parser.GetLiteralSize());
+                bodyTarget = body.get();
+            }
+        }
+        if (!this->Parser.IsResponseComplete())
+            continue;
+        if (this->Parser.IsTagged())
+        {
+            completedTag = this->Parser.GetTag();
+            return Utils::IMAPCL_SUCCESS;
+        }
+        // Untagged FETCH response is complete, storing what it carried until its command completes
+        uint32_t uid;
+        if (UIDSet::ParseUID(responseUID, uid))
         {
-            this->FullResponse += this->Buffer.substr(0, received);
-            // Keep listening on the port until '*' + OK/NO/BAD is present, so we can stop reading
-            if (!Utils::ValidateResponse(this->FullResponse, "\\*\\sOK") ||
-                !Utils::ValidateResponse(this->FullResponse, "\\*\\sNO") ||
-                !Utils::ValidateResponse(this->FullResponse, "\\*\\sBAD"))
+            if (!responseSize.empty())
+                this->MessageSizes[uid] = std::strtoul(responseSize.c_str(), nullptr, 10);
+            if (body)
+            {
+                body->SetMessageUID(responseUID);
+                this->ReceivedMessages[uid] = std::move(body);
+            }
+            else if (headerLiteral)
+                this->ReceivedMessages[uid] = std::make_unique<HeaderMessage>(responseUID, responseText);
+        }
+        responseUID = "";
+        responseSize = "";
+        responseText = "";
+        body.reset();
+        bodyTarget = nullptr;
+        bodyLiteral = false;
+        headerLiteral = false;
+    }
+}
+
+Utils::ReturnCodes Session::RunFetchCommands(FetchQueue &queue, unsigned int worker, unsigned int &numOfDownloaded)
+{
+    std::deque<FetchCommand> inFlightCommands;
+    bool queueEmpty = false;
+    while (!queueEmpty || !inFlightCommands.empty())
+    {
+        // Keeping the window of commands in flight full
+        while (!queueEmpty && inFlightCommands.size() < this->Options.PipelineDepth)
+        {
+            FetchCommand command;
+            if (!queue.Pop(worker, command))
+            {
+                queueEmpty = true;
                 break;
+            }
+            command.Tag = "A" + std::to_string(this->CurrentTagNumber);
+            std::string items = " BODY[]";
+            if (command.Item == FETCH_HEADERS)
+                items = " BODY.PEEK[HEADER]";
+            else if (command.Item == FETCH_SIZE)
+                items = " RFC822.SIZE";
+            std::string sequenceSet = command.MessageUIDs.ToSequenceSet();
+#ifdef DEBUG
+            std::cerr << "Fetching" << items << " of messages with UIDs: " << sequenceSet << std::endl;
+#endif
+            if ((this->ReturnCode = this->SendMessage("UID FETCH " + sequenceSet + items)))
+                return this->ReturnCode;
+            this->CurrentTagNumber++;
+            inFlightCommands.push_back(command);
+        }
+        if (inFlightCommands.empty())
+            break;
+        std::string completedTag;
+        if ((this->ReturnCode = this->ReceiveFetchResponses(completedTag)))
+            return this->ReturnCode;
+        auto completedCommand =
+            std::find_if(inFlightCommands.begin(), inFlightCommands.end(),
+                         [&completedTag](const FetchCommand &command) { return command.Tag == completedTag; });
+        if (completedCommand == inFlightCommands.end())
+            continue;
+        if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
+        {
+            this->Logout();
+            return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
+        }
+        completedCommand->Completed = true;
+        // Messages are handed over to be written in the order their commands were sent
+        while (!inFlightCommands.empty() && inFlightCommands.front().Completed)
+        {
+            FetchCommand command = inFlightCommands.front();
+            inFlightCommands.pop_front();
+            if (command.Item == FETCH_SIZE)
+                continue;
+            std::vector<uint32_t> storedUIDs;
+            for (const auto &interval : command.MessageUIDs.GetIntervals())
+            {
+                // Only messages that arrived are visited, messages expunged in the meantime are simply missing
+                auto message = this->ReceivedMessages.lower_bound(interval.First);
+                while (message != this->ReceivedMessages.end() && message->first <= interval.Last)
+                {
+                    message->second->ParseFileName(this->ServerHostname, this->MailBoxFileName);
+                    message->second->ParseMessageBody();
+                    // Message that could not be stored is not counted as downloaded
+                    if (message->second->DumpToFile(*this->Store))
+                    {
+                        storedUIDs.push_back(message->first);
+                        numOfDownloaded++;
+                    }
+                    message = this->ReceivedMessages.erase(message);
+                }
+            }
+            // Messages are recorded in the index only once the store has recorded them too
+            if (!this->Store->Flush() || !this->Index)
+                continue;
+            for (const auto &messageUID : storedUIDs)
+                this->Index->Add(messageUID, command.Item == FETCH_HEADERS ? LocalIndex::STORED_HEADERS
+                                                                           : LocalIndex::STORED_MESSAGE);
         }
     }
-    this->Buffer = std::string("", BUFFER_SIZE);
     return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes Session::ReceiveTaggedResponse()
+std::string Session::PartialFilePath(const std::string &name) const
+{
+    // Partial file of a mailbox with another UIDVALIDITY is never resumed
+    return this->Store->TemporaryFilePath(name + "_" + this->MailBoxValidity + "_" + this->MailBoxFileName + "_" +
+                                          this->ServerHostname);
+}
+
+UIDSet Session::ListPartialUIDs() const
+{
+    // Partial files are named '<UID><suffix>', the store may put a dot in front of them
+    std::string partialSuffix = std::filesystem::path(this->PartialFilePath("")).filename();
+    if (!partialSuffix.empty() && partialSuffix[0] == '.')
+        partialSuffix.erase(0, 1);
+    std::vector<uint32_t> partialUIDs;
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(std::filesystem::path(this->PartialFilePath("")).parent_path(), error))
+    {
+        std::string fileName = entry.path().filename();
+        std::size_t start = (!fileName.empty() && fileName[0] == '.') ? 1 : 0;
+        uint32_t uid;
+        if (fileName.length() > start + partialSuffix.length() &&
+            !fileName.compare(fileName.length() - partialSuffix.length(), partialSuffix.length(), partialSuffix) &&
+            UIDSet::ParseUID(fileName.substr(start, fileName.length() - partialSuffix.length() - start), uid))
+            partialUIDs.push_back(uid);
+    }
+    return UIDSet(partialUIDs);
+}
+
+Utils::ReturnCodes Session::FetchMessageInChunks(uint32_t uid, unsigned int &numOfDownloaded)
 {
+    std::string messageUID = std::to_string(uid);
+    std::size_t chunkBytes = this->Options.ChunkBytes ? this->Options.ChunkBytes : RESUME_CHUNK_SIZE;
+    this->ChunkedMessage =
+        std::make_unique<StreamedMessage>(messageUID, this->PartialFilePath(messageUID), 0, true);
+    std::size_t offset = this->ChunkedMessage->GetStoredLength();
     while (true)
     {
-        unsigned long int received = recv(this->SocketDescriptor, this->Buffer.data(), BUFFER_SIZE, 0);
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
-            return Utils::PrintError(Utils::SOCKET_TIMED_OUT, "Timed out");
-        if (received != 0)
+        std::string tag = "A" + std::to_string(this->CurrentTagNumber);
+#ifdef DEBUG
+        std::cerr << "Fetching chunk at " << offset << " of message with UID: " << messageUID << std::endl;
+#endif
+        // Size the stored message is checked against is requested with the first chunk unless it is known already
+        std::string items = this->MessageSizes.count(uid) ? "(" : "(RFC822.SIZE ";
+        if ((this->ReturnCode = this->SendMessage("UID FETCH " + messageUID + " " + items + "BODY[]<" +
+                                                  std::to_string(offset) + "." + std::to_string(chunkBytes) + ">)")))
+            break;
+        this->CurrentTagNumber++;
+        this->ChunkLength = 0;
+        this->ChunkArrived = false;
+        std::string completedTag;
+        do
         {
-            this->FullResponse += this->Buffer.substr(0, received);
-            // Keep listening on the port until 'current tag' + OK/NO/BAD is present, so we can stop reading
-            if (!Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK") ||
-                !Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sNO") ||
-                !Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sBAD"))
+            if ((this->ReturnCode = this->ReceiveFetchResponses(completedTag)))
                 break;
+        } while (completedTag != tag);
+        if (this->ReturnCode)
+            break;
+        if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
+        {
+            this->ReturnCode = Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
+            break;
         }
+        // Message expunged in the meantime or body not sent as a literal (i.e. NIL)
+        if (!this->ChunkArrived)
+            break;
+        // Every complete chunk is made durable, an interrupted download continues after it
+        if (!this->ChunkedMessage->Flush())
+        {
+            this->ReturnCode = Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed writing message file");
+            break;
+        }
+        offset += this->ChunkLength;
+        if (this->ChunkLength < chunkBytes)
+            break;
+    }
+    std::unique_ptr<StreamedMessage> message = std::move(this->ChunkedMessage);
+    if (this->ReturnCode)
+        return this->ReturnCode;
+    // Nothing came back for a message expunged in the meantime
+    if (offset == 0 && !this->ChunkArrived)
+    {
+        message.reset();
+        std::filesystem::remove(this->PartialFilePath(messageUID));
+        return Utils::IMAPCL_SUCCESS;
     }
-    this->Buffer = std::string("", BUFFER_SIZE);
+    // Truncated message is kept in its partial file, the next sync continues it
+    auto size = this->MessageSizes.find(uid);
+    if (!this->ChunkArrived || (size != this->MessageSizes.end() && size->second != offset))
+    {
+        Utils::PrintError(Utils::INVALID_RESPONSE, "Message " + messageUID + " was not received completely");
+        return Utils::IMAPCL_SUCCESS;
+    }
+    message->ParseFileName(this->ServerHostname, this->MailBoxFileName);
+    if (!message->DumpToFile(*this->Store))
+        return Utils::IMAPCL_SUCCESS;
+    numOfDownloaded++;
+    if (this->Store->Flush() && this->Index)
+        this->Index->Add(uid, LocalIndex::STORED_MESSAGE);
+    return Utils::IMAPCL_SUCCESS;
+}
+
+std::unique_ptr<Session> Session::CreateWorkerSession()
+{
+    return std::make_unique<Session>(this->ServerHostname, this->Port, this->Username, this->Password,
+                                     this->OutDirectoryPath, this->MailBox, this->Options);
+}
+
+Utils::ReturnCodes Session::OpenConnection()
+{
+    if ((this->ReturnCode = this->GetHostAddressInfo()))
+        return this->ReturnCode;
+    if ((this->ReturnCode = this->Connect()))
+        return this->ReturnCode;
+    return this->Authenticate();
+}
+
+void Session::SetMailBox(const std::string &mailBox)
+{
+    this->MailBox = mailBox;
+    this->MailBoxFileName = Utils::MailboxFileName(mailBox);
+}
+
+Utils::ReturnCodes Session::FetchMessages(const UIDSet &messageUIDs, const bool headersOnly,
+                                          unsigned int &numOfDownloaded)
+{
+    if (!headersOnly && (this->Options.BatchBytes > 0 || this->Options.ChunkBytes > 0))
+    {
+        // Sizes of all messages are needed up front only if batches are bounded by bytes or large messages are
+        // fetched in chunks, whole ranges of UIDs are requested at once
+        FetchQueue sizeQueue(1);
+        UIDSet commandUIDs;
+        std::size_t commandLength = 0;
+        for (const auto &interval : messageUIDs.GetIntervals())
+        {
+            std::size_t rangeLength = Utils::SequenceRangeLength(interval.First, interval.Last);
+            if (!commandUIDs.Empty() && commandLength + rangeLength > MAX_SEQUENCE_SET_LENGTH)
+            {
+                sizeQueue.Push({commandUIDs, FETCH_SIZE, "", false});
+                commandUIDs = UIDSet();
+                commandLength = 0;
+            }
+            commandUIDs.Insert(interval.First, interval.Last);
+            commandLength += rangeLength;
+        }
+        if (!commandUIDs.Empty())
+            sizeQueue.Push({commandUIDs, FETCH_SIZE, "", false});
+        if ((this->ReturnCode = this->RunFetchCommands(sizeQueue, 0, numOfDownloaded)))
+            return this->ReturnCode;
+    }
+    unsigned int connections = this->Options.Connections;
+    unsigned int batchCount = this->Options.BatchCount;
+    if (connections > 1)
+    {
+        // Every connection gets several batches, so the ones finishing early have something to take over
+        unsigned long batchesPerConnection = 4;
+        unsigned long fairBatchCount = (messageUIDs.Size() + connections * batchesPerConnection - 1) /
+                                       (connections * batchesPerConnection);
+        batchCount = std::max<unsigned long>(1, std::min<unsigned long>(batchCount, fairBatchCount));
+    }
+    // Grouping messages into batches bounded by count, bytes and length of the sequence set. UIDs are visited in
+    // ascending order straight from the intervals of the set, so consecutive UIDs end up in the same ranges
+    FetchQueue queue(connections);
+    unsigned int numOfBatches = 0;
+    UIDSet partialUIDs = headersOnly ? UIDSet() : this->ListPartialUIDs();
+    UIDSet batchUIDs;
+    UIDSet chunkedUIDs;
+    unsigned int batchSize = 0;
+    unsigned long batchBytes = 0;
+    std::size_t batchLength = 0;
+    uint32_t batchLast = 0;
+    for (const auto &interval : messageUIDs.GetIntervals())
+        for (uint64_t messageUID = interval.First; messageUID <= interval.Last; messageUID++)
+        {
+            uint32_t uid = messageUID;
+            auto size = this->MessageSizes.find(uid);
+            unsigned long messageBytes = size != this->MessageSizes.end() ? size->second : 0;
+            if (!headersOnly &&
+                ((this->Options.ChunkBytes && messageBytes > this->Options.ChunkBytes) || partialUIDs.Contains(uid)))
+            {
+                chunkedUIDs.Insert(uid);
+                continue;
+            }
+            // UID following the last one of the batch only extends its last range, a new range is counted as if it
+            // was extended already
+            std::size_t uidLength = (batchSize && uid == batchLast + 1) ? 0 : Utils::SequenceRangeLength(uid, uid + 1);
+            if (batchSize && (batchSize >= batchCount ||
+                              (this->Options.BatchBytes && batchBytes + messageBytes > this->Options.BatchBytes) ||
+                              batchLength + uidLength > MAX_SEQUENCE_SET_LENGTH))
+            {
+                queue.Push({batchUIDs, headersOnly ? FETCH_HEADERS : FETCH_BODY, "", false});
+                numOfBatches++;
+                batchUIDs = UIDSet();
+                batchSize = 0;
+                batchBytes = 0;
+                batchLength = 0;
+                uidLength = Utils::SequenceRangeLength(uid, uid + 1);
+            }
+            batchUIDs.Insert(uid);
+            batchSize++;
+            batchBytes += messageBytes;
+            batchLength += uidLength;
+            batchLast = uid;
+        }
+    if (batchSize)
+    {
+        queue.Push({batchUIDs, headersOnly ? FETCH_HEADERS : FETCH_BODY, "", false});
+        numOfBatches++;
+    }
+    // Additional connections are opened only for the time of fetching and only if there are batches for them
+    connections = std::min(connections, numOfBatches);
+    std::vector<std::thread> workers;
+    std::vector<unsigned int> workersDownloaded(connections, 0);
+    std::vector<Utils::ReturnCodes> workersReturnCodes(connections, Utils::IMAPCL_SUCCESS);
+    for (unsigned int worker = 1; worker < connections; worker++)
+    {
+        workers.emplace_back([this, worker, &queue, &workersDownloaded, &workersReturnCodes]() {
+            std::unique_ptr<Session> session = this->CreateWorkerSession();
+            session->WorkerNumber = worker;
+            // Connection refused by the server leaves its batches to the other connections, the mailbox was already
+            // validated by the first connection
+            if (session->OpenConnection() || session->SelectMailbox(false))
+                return;
+            if ((workersReturnCodes[worker] = session->RunFetchCommands(queue, worker, workersDownloaded[worker])))
+                return;
+            workersReturnCodes[worker] = session->Logout();
+        });
+    }
+    Utils::ReturnCodes returnCode = this->RunFetchCommands(queue, 0, numOfDownloaded);
+    for (auto &worker : workers)
+        worker.join();
+    for (unsigned int worker = 1; worker < connections; worker++)
+    {
+        numOfDownloaded += workersDownloaded[worker];
+        if (!returnCode)
+            returnCode = workersReturnCodes[worker];
+    }
+    // Large messages are fetched one by one on the first connection, each of them in chunks
+    for (const auto &interval : chunkedUIDs.GetIntervals())
+        for (uint64_t messageUID = interval.First; messageUID <= interval.Last && !returnCode; messageUID++)
+            returnCode = this->FetchMessageInChunks(messageUID, numOfDownloaded);
+    if ((this->ReturnCode = returnCode))
+        return this->ReturnCode;
+    this->MessageSizes.clear();
+    this->FullResponse = "";
     return Utils::IMAPCL_SUCCESS;
 }
 
@@ -110,18 +712,18 @@ Utils::ReturnCodes Session::SendMessage(const std::string &message)
 {
     std::string messageBuffer = "A" + std::to_string(this->CurrentTagNumber) + " ";
     messageBuffer += message + "\n";
-    if (send(this->SocketDescriptor, messageBuffer.c_str(), messageBuffer.length(), 0) == -1)
+    if (this->Send(messageBuffer.c_str(), messageBuffer.length()) <= 0)
         return Utils::PrintError(Utils::SOCKET_WRITING, "Failed writing to a socket");
     return Utils::IMAPCL_SUCCESS;
 }
 
 Utils::ReturnCodes Session::Connect()
 {
-    if (connect(this->SocketDescriptor, Server->ai_addr, Server->ai_addrlen) == -1)
-        return Utils::PrintError(Utils::SOCKET_CONNECTING, "Connecting to socket failed");
+    if ((this->ReturnCode = this->ConnectSocket()))
+        return this->ReturnCode;
     if ((this->ReturnCode = this->ReceiveUntaggedResponse()))
         return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "\\*\\sOK"))
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
         return Utils::PrintError(Utils::INVALID_RESPONSE, "Response is invalid");
     this->FullResponse = "";
     return Utils::IMAPCL_SUCCESS;
@@ -133,9 +735,9 @@ Utils::ReturnCodes Session::Authenticate()
         return this->ReturnCode;
     if ((this->ReturnCode = this->ReceiveTaggedResponse()))
         return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sNO"))
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_NO)
     {
-        if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+        if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
         {
             this->CurrentTagNumber++;
             this->Logout();
@@ -143,9 +745,11 @@ Utils::ReturnCodes Session::Authenticate()
         }
         else
         {
+            // Servers usually announce their capabilities after login in the response code
+            this->Capabilities = Utils::ParseCapabilities(this->FullResponse);
             this->FullResponse = "";
             this->CurrentTagNumber++;
-            return Utils::IMAPCL_SUCCESS;
+            return this->EnableCompression();
         }
     }
     else
@@ -158,81 +762,255 @@ Utils::ReturnCodes Session::Authenticate()
     return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes Session::ValidateMailbox()
+Utils::ReturnCodes Session::RequestCapabilities()
 {
-    std::regex validityRegex("UIDVALIDITY\\s([0-9]+)", std::regex_constants::icase);
-    std::smatch validityMatch;
-    std::regex_search(this->FullResponse, validityMatch, validityRegex);
-    std::string UIDValidity = validityMatch[1];
-    std::string validityFile = this->OutDirectoryPath + "/." + this->ServerHostname + "_" + this->MailBox + "_validity";
+    if ((this->ReturnCode = this->SendMessage("CAPABILITY")))
+        return this->ReturnCode;
+    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+        return this->ReturnCode;
+    this->CurrentTagNumber++;
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
+        return Utils::PrintError(Utils::INVALID_RESPONSE, "Response is invalid");
+    this->Capabilities = Utils::ParseCapabilities(this->FullResponse);
+    this->FullResponse = "";
+    return Utils::IMAPCL_SUCCESS;
+}
+
+bool Session::HasCapability(const std::string &capability)
+{
+    if (this->Capabilities.empty() && this->RequestCapabilities())
+        return false;
+    return std::find(this->Capabilities.begin(), this->Capabilities.end(), capability) != this->Capabilities.end();
+}
+
+Utils::ReturnCodes Session::EnableCompression()
+{
+    if (!this->Options.Compress || this->Compression || !this->HasCapability("COMPRESS=DEFLATE"))
+        return Utils::IMAPCL_SUCCESS;
+    auto compression = std::make_unique<DeflateStream>();
+    if (!compression->IsInitialized())
+        return Utils::IMAPCL_SUCCESS;
+#ifdef DEBUG
+    std::cerr << " compressing...";
+#endif
+    if ((this->ReturnCode = this->SendMessage("COMPRESS DEFLATE")))
+        return this->ReturnCode;
+    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+        return this->ReturnCode;
+    this->CurrentTagNumber++;
+    this->FullResponse = "";
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
+        return Utils::IMAPCL_SUCCESS;
+    // Everything the server sends after the tagged response is compressed, including bytes already received
+    this->Compression = std::move(compression);
+    this->CompressedBuffer = std::string(LITERAL_CHUNK_SIZE, '\0');
+    if (this->BufferStart < this->BufferEnd)
+    {
+        std::copy(this->Buffer.begin() + this->BufferStart, this->Buffer.begin() + this->BufferEnd,
+                  this->CompressedBuffer.begin());
+        Statistics::Add(Statistics::COMPRESSED_BYTES, this->BufferEnd - this->BufferStart);
+        this->Compression->SetInput(this->CompressedBuffer.data(), this->BufferEnd - this->BufferStart);
+        this->BufferStart = this->BufferEnd;
+    }
+    return Utils::IMAPCL_SUCCESS;
+}
+
+std::string Session::ValidityFilePath() const
+{
+    return this->OutDirectoryPath + "/." + this->ServerHostname + "_" + this->MailBoxFileName + "_validity";
+}
+
+std::string Session::IndexFilePath() const
+{
+    return this->OutDirectoryPath + "/." + this->ServerHostname + "_" + this->MailBoxFileName + "_index";
+}
+
+std::tuple<UIDSet, UIDSet> Session::ScanLocalMailDirectory()
+{
+    std::vector<uint32_t> messages;
+    std::vector<uint32_t> headers;
+    for (const auto &file : this->Store->ListMessageFiles())
+    {
+        // Only messages of the selected mailbox on the current server are considered
+        std::string fileName = file.filename();
+        std::string messageUID = Utils::ExtractLocalMessageUID(fileName, this->MailBoxFileName, this->ServerHostname);
+        uint32_t uid;
+        if (!UIDSet::ParseUID(messageUID, uid))
+            continue;
+        (this->Store->IsHeadersOnly(fileName) ? headers : messages).push_back(uid);
+    }
+    return {UIDSet(std::move(messages)), UIDSet(std::move(headers))};
+}
+
+void Session::LoadLocalIndex()
+{
+    if (this->Index->Load(this->MailBoxValidity))
+        return;
+#ifdef DEBUG
+    std::cerr << "Rebuilding local mail index... ";
+#endif
+    auto [messages, headers] = this->ScanLocalMailDirectory();
+    if (!this->Index->Rebuild(this->MailBoxValidity, messages, headers))
+        Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed writing local mail index");
+#ifdef DEBUG
+    std::cerr << "DONE" << std::endl;
+#endif
+}
+
+Utils::ReturnCodes Session::LoadSyncState()
+{
+    this->StoredValidity = "";
+    this->StoredModSeq = 0;
+    this->StoredUidNext = 0;
+    this->StoredHeadersOnly = false;
     struct stat buffer;
-    if (stat(validityFile.c_str(), &buffer) != 0)
+    if (stat(this->ValidityFilePath().c_str(), &buffer) != 0)
+        return Utils::IMAPCL_SUCCESS;
+    std::ifstream file(this->ValidityFilePath());
+    if (!file.is_open())
+        return Utils::PrintError(Utils::VALIDITY_FILE_OPEN, "Could not open validity file");
+    std::getline(file, this->StoredValidity);
+    std::string mode;
+    // Validity files written before modification sequences were kept have only the first line
+    if (!(file >> this->StoredModSeq >> this->StoredUidNext >> mode))
     {
-        std::ofstream file(validityFile);
-        file << UIDValidity << std::endl;
+        this->StoredModSeq = 0;
+        this->StoredUidNext = 0;
+    }
+    this->StoredHeadersOnly = mode == "headers";
+    return Utils::IMAPCL_SUCCESS;
+}
+
+void Session::SaveSyncState(const bool headersOnly)
+{
+    std::ofstream file(this->ValidityFilePath());
+    file << this->MailBoxValidity << std::endl;
+    file << this->HighestModSeq << " " << this->UidNext << (headersOnly ? " headers" : " full") << std::endl;
+    file.close();
+    this->StoredValidity = this->MailBoxValidity;
+    this->StoredModSeq = this->HighestModSeq;
+    this->StoredUidNext = this->UidNext;
+    this->StoredHeadersOnly = headersOnly;
+}
+
+Utils::ReturnCodes Session::EnableQresync()
+{
+    if (this->QresyncEnabled || !this->HasCapability("QRESYNC"))
+        return Utils::IMAPCL_SUCCESS;
+    if ((this->ReturnCode = this->SendMessage("ENABLE QRESYNC")))
+        return this->ReturnCode;
+    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+        return this->ReturnCode;
+    this->QresyncEnabled = this->Parser.GetStatus() == ResponseParser::STATUS_OK &&
+                           std::regex_search(this->FullResponse, std::regex("\\* ENABLED [^\r\n]*QRESYNC",
+                                                                            std::regex_constants::icase));
+    this->CurrentTagNumber++;
+    this->FullResponse = "";
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes Session::ValidateMailbox()
+{
+    if (this->StoredValidity.empty())
+    {
+        std::ofstream file(this->ValidityFilePath());
+        file << this->MailBoxValidity << std::endl;
         file.close();
     }
-    else
+    else if (this->StoredValidity.compare(this->MailBoxValidity))
     {
-        std::ifstream file(validityFile);
-        std::string line;
-        if (!file.is_open())
-            return Utils::PrintError(Utils::VALIDITY_FILE_OPEN, "Could not open validity file");
-        while (std::getline(file, line))
+        // Clearing out local mail directory, because UIDValidity file needs to be updated
+        // and mail will need to be redownloaded
+        for (const auto &file : this->Store->ListMessageFiles())
         {
-            if (line.compare(validityMatch[1]))
-            {
-                // Clearing out local mail directory, because UIDValidity file needs to be updated
-                // and mail will need to be redownloaded
-                for (const auto &entry : std::filesystem::directory_iterator(this->OutDirectoryPath))
-                {
-                    std::string fileName = entry.path();
-                    std::regex messageUIDRegex =
-                        std::regex("([0-9]+)_" + this->MailBox + "_" + this->ServerHostname + "_(.+)",
-                                   std::regex_constants::icase);
-                    std::smatch messageUIDMatch;
-                    if (std::regex_search(fileName, messageUIDMatch, messageUIDRegex))
-                        std::filesystem::remove_all(entry.path());
-                }
-                // Updating UIDValidity file to a new value
-                std::ofstream file(validityFile);
-                file << validityMatch[1] << std::endl;
-                file.close();
-                break;
-            }
+            std::string fileName = file.filename();
+            if (!Utils::ExtractLocalMessageUID(fileName, this->MailBoxFileName, this->ServerHostname).empty())
+                this->Store->Remove(file);
+        }
+        this->Store->Flush();
+        // Partial downloads belong to messages of the old mailbox
+        std::error_code error;
+        std::string partialSuffix = "_" + this->MailBoxFileName + "_" + this->ServerHostname + ".part";
+        std::filesystem::path partialDirectory = std::filesystem::path(this->PartialFilePath("")).parent_path();
+        for (const auto &entry : std::filesystem::directory_iterator(partialDirectory, error))
+        {
+            std::string fileName = entry.path().filename();
+            if (fileName.length() > partialSuffix.length() &&
+                !fileName.compare(fileName.length() - partialSuffix.length(), partialSuffix.length(), partialSuffix))
+                std::filesystem::remove(entry.path(), error);
         }
+        // Updating UIDValidity file to a new value, modification sequences and UIDs of the old mailbox mean nothing
+        std::ofstream file(this->ValidityFilePath());
+        file << this->MailBoxValidity << std::endl;
+        file.close();
+        this->StoredModSeq = 0;
+        this->StoredUidNext = 0;
     }
     return Utils::IMAPCL_SUCCESS;
 }
 
-Utils::ReturnCodes Session::SelectMailbox()
+Utils::ReturnCodes Session::SelectMailbox(const bool validateMailbox)
 {
 #ifdef DEBUG
     std::cerr << "Selecting mailbox " << this->MailBox << "... ";
 #endif
+    // Changes since the previous sync are reported by SELECT with QRESYNC, CONDSTORE only reports HIGHESTMODSEQ
+    std::string parameters = "";
+    this->HighestModSeq = 0;
+    this->QresyncSelected = false;
+    this->ChangedMessageUIDs = UIDSet();
+    if (validateMailbox)
+    {
+        if ((this->ReturnCode = this->LoadSyncState()))
+            return this->ReturnCode;
+        if (this->StoredModSeq && (this->ReturnCode = this->EnableQresync()))
+            return this->ReturnCode;
+        if (this->QresyncEnabled && this->StoredModSeq)
+        {
+            parameters = " (QRESYNC (" + this->StoredValidity + " " + std::to_string(this->StoredModSeq) + "))";
+            this->QresyncSelected = true;
+        }
+        else if (this->HasCapability("CONDSTORE"))
+            parameters = " (CONDSTORE)";
+    }
     // Selecting mailbox
-    this->SendMessage("SELECT " + this->MailBox);
+    if ((this->ReturnCode = this->SendMessage("SELECT " + Utils::QuoteString(this->MailBox) + parameters)))
+        return this->ReturnCode;
     if ((this->ReturnCode = this->ReceiveTaggedResponse()))
         return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
     {
         this->CurrentTagNumber++;
         this->Logout();
-        return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
+        return Utils::PrintError(Utils::CANT_ACCESS_MAILBOX, "Can't access mailbox");
     }
 #ifdef DEBUG
     std::cerr << "DONE" << std::endl;
 #endif
+    // Messages delivered after selecting get at least UIDNEXT, it is raised by UIDs seen later
+    std::smatch uidNextMatch;
+    this->UidNext = 1;
+    if (std::regex_search(this->FullResponse, uidNextMatch, std::regex("UIDNEXT\\s([0-9]+)", std::regex::icase)))
+        this->UidNext = std::strtoul(uidNextMatch[1].str().c_str(), nullptr, 10);
+    // Names of partial files hold UIDVALIDITY, so workers need it too
+    std::smatch validityMatch;
+    std::regex_search(this->FullResponse, validityMatch, std::regex("UIDVALIDITY\\s([0-9]+)", std::regex::icase));
+    this->MailBoxValidity = validityMatch[1];
+    this->HighestModSeq = Utils::ParseHighestModSeq(this->FullResponse);
+    if (this->QresyncSelected)
+        this->ChangedMessageUIDs = UIDSet(Utils::ParseFetchedUIDs(this->FullResponse));
 #ifdef DEBUG
     std::cerr << "Checking validity... ";
 #endif
     // Checking UIDValidity of the mailbox
-    if ((this->ReturnCode = this->ValidateMailbox()))
+    if (validateMailbox && (this->ReturnCode = this->ValidateMailbox()))
     {
         this->CurrentTagNumber++;
         this->Logout();
         return this->ReturnCode;
     }
+    // Index is loaded once there is remote mail to compare with it, until then stored messages are only recorded
+    this->Index = std::make_unique<LocalIndex>(this->IndexFilePath());
 #ifdef DEBUG
     std::cerr << "DONE" << std::endl;
 #endif
@@ -241,9 +1019,9 @@ Utils::ReturnCodes Session::SelectMailbox()
     return Utils::IMAPCL_SUCCESS;
 }
 
-std::tuple<std::vector<std::string>, Utils::ReturnCodes> Session::SearchMailbox(const std::string &searchKey)
+std::tuple<UIDSet, Utils::ReturnCodes> Session::SearchMailbox(const std::string &searchKey)
 {
-    std::vector<std::string> messageUIDs;
+    UIDSet messageUIDs;
 #ifdef DEBUG
     std::cerr << "Searching for " << searchKey << "... ";
 #endif
@@ -252,7 +1030,7 @@ std::tuple<std::vector<std::string>, Utils::ReturnCodes> Session::SearchMailbox(
         return {messageUIDs, this->ReturnCode};
     if ((this->ReturnCode = this->ReceiveTaggedResponse()))
         return {messageUIDs, this->ReturnCode};
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
     {
         this->CurrentTagNumber++;
         this->Logout();
@@ -261,69 +1039,189 @@ std::tuple<std::vector<std::string>, Utils::ReturnCodes> Session::SearchMailbox(
 #ifdef DEBUG
     std::cerr << "DONE" << std::endl;
 #endif
-    // Extracting line with UIDs of mail
-    std::regex removeSecondLine("A" + std::to_string(this->CurrentTagNumber) + "[\\s\\S]+");
-    this->FullResponse = std::regex_replace(this->FullResponse, removeSecondLine, "");
-    std::regex regex("[0-9]+", std::regex_constants::icase);
-    std::smatch match;
-    std::string::const_iterator start(this->FullResponse.cbegin());
-    while (std::regex_search(start, this->FullResponse.cend(), match, regex))
+    // Extracting UIDs only from SEARCH responses, other untagged responses (i.e. '* 5 EXISTS') may come with them
+    std::istringstream responseLines(this->FullResponse);
+    std::string line;
+    std::vector<uint32_t> uids;
+    while (std::getline(responseLines, line))
     {
-        messageUIDs.push_back(match[0]);
-        start = match.suffix().first;
+        if (strncasecmp(line.c_str(), "* SEARCH", 8))
+            continue;
+        // Search by MODSEQ ends with the highest modification sequence of the found messages (i.e. '(MODSEQ 917)')
+        line = line.substr(0, line.find('('));
+        uint64_t uid = 0;
+        bool inNumber = false;
+        for (char c : line + " ")
+        {
+            if (std::isdigit(static_cast<unsigned char>(c)))
+            {
+                uid = uid * 10 + (c - '0');
+                inNumber = true;
+            }
+            else if (inNumber)
+            {
+                uids.push_back(static_cast<uint32_t>(uid));
+                uid = 0;
+                inNumber = false;
+            }
+        }
     }
+    messageUIDs = UIDSet(std::move(uids));
 
     this->FullResponse = "";
     this->CurrentTagNumber++;
     return {messageUIDs, Utils::IMAPCL_SUCCESS};
 }
 
-std::vector<std::string> Session::SearchLocalMailDirectoryForFullMail()
+std::tuple<UIDSet, Utils::ReturnCodes> Session::SearchMailboxSince(unsigned long uid)
 {
-    std::vector<std::string> localMessagesUIDs;
-    for (const auto &entry : std::filesystem::directory_iterator(this->OutDirectoryPath))
+    UIDSet messageUIDs;
+    std::tie(messageUIDs, this->ReturnCode) = this->SearchMailbox("UID " + std::to_string(uid) + ":*");
+    // 'N:*' matches the last message of the mailbox even if its UID is lower than N
+    UIDSet lowerUIDs;
+    if (uid > 1)
+        lowerUIDs.Insert(1, static_cast<uint32_t>(uid - 1));
+    return {messageUIDs.Difference(lowerUIDs), this->ReturnCode};
+}
+
+UIDSet Session::SearchLocalMailDirectoryForFullMail()
+{
+    // Directory is only scanned if there are headers to be deleted
+    if (!this->Index->GetHeaders().Empty())
     {
-        std::string fileName = entry.path();
-        std::regex messageUIDRegex("([0-9]+)(.+)", std::regex_constants::icase);
-        std::regex messageHeadersRegex("([0-9]+)(.+)(_h)", std::regex_constants::icase);
-        std::smatch messageUIDMatch;
-        std::smatch messageHeadersMatch;
-        if (std::regex_search(fileName, messageUIDMatch, messageUIDRegex))
+        for (const auto &file : this->Store->ListMessageFiles())
         {
-            if (std::regex_search(fileName, messageHeadersMatch, messageHeadersRegex))
-            {
-                std::filesystem::remove_all(entry.path());
-            }
-            else
-                localMessagesUIDs.push_back(messageUIDMatch[1]);
+            // Only messages of the selected mailbox on the current server are considered
+            std::string fileName = file.filename();
+            if (Utils::ExtractLocalMessageUID(fileName, this->MailBoxFileName, this->ServerHostname).empty())
+                continue;
+            if (this->Store->IsHeadersOnly(fileName))
+                this->Store->Remove(file);
         }
+        this->Store->Flush();
+        this->Index->Rebuild(this->MailBoxValidity, UIDSet(this->Index->GetMessages()), UIDSet());
     }
-    return localMessagesUIDs;
+    return this->Index->GetMessages();
 }
 
-std::vector<std::string> Session::SearchLocalMailDirectoryForAll()
+UIDSet Session::SearchLocalMailDirectoryForAll()
 {
-    std::vector<std::string> localMessagesUIDs;
-    for (const auto &entry : std::filesystem::directory_iterator(this->OutDirectoryPath))
+    return this->Index->GetMessages().Union(this->Index->GetHeaders());
+}
+
+std::tuple<std::vector<std::string>, Utils::ReturnCodes> Session::ListMailboxes(const std::string &pattern)
+{
+    std::vector<std::string> mailBoxes;
+#ifdef DEBUG
+    std::cerr << "Listing mailboxes matching " << pattern << "... ";
+#endif
+    if ((this->ReturnCode = this->SendMessage("LIST \"\" " + Utils::QuoteString(pattern))))
+        return {mailBoxes, this->ReturnCode};
+    if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+        return {mailBoxes, this->ReturnCode};
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
     {
-        std::string fileName = entry.path();
-        std::regex messageUIDRegex("([0-9]+)(.+)", std::regex_constants::icase);
-        std::smatch messageUIDMatch;
-        if (std::regex_search(fileName, messageUIDMatch, messageUIDRegex))
-            localMessagesUIDs.push_back(messageUIDMatch[1]);
+        this->CurrentTagNumber++;
+        this->Logout();
+        return {mailBoxes, Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response")};
     }
-    return localMessagesUIDs;
+#ifdef DEBUG
+    std::cerr << "DONE" << std::endl;
+#endif
+    mailBoxes = Utils::ParseListResponse(this->FullResponse);
+    this->FullResponse = "";
+    this->CurrentTagNumber++;
+    return {mailBoxes, Utils::IMAPCL_SUCCESS};
+}
+
+Utils::ReturnCodes Session::FetchListedMailboxes(const std::vector<std::string> &mailBoxes,
+                                                 std::atomic<std::size_t> &nextMailBox, const bool headersOnly,
+                                                 const bool newMailOnly)
+{
+    std::size_t mailBox;
+    while ((mailBox = nextMailBox++) < mailBoxes.size())
+    {
+        this->SetMailBox(mailBoxes[mailBox]);
+        if ((this->ReturnCode = this->FetchMail(headersOnly, newMailOnly)))
+            return this->ReturnCode;
+    }
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes Session::FetchMailboxes(const std::string &pattern, const bool headersOnly, const bool newMailOnly)
+{
+    std::vector<std::string> mailBoxes;
+    std::tie(mailBoxes, this->ReturnCode) = this->ListMailboxes(pattern);
+    if (this->ReturnCode)
+        return this->ReturnCode;
+    // Connections are shared by the mailboxes, each mailbox is fetched over a single connection
+    unsigned int connections = std::min<std::size_t>(this->Options.Connections, mailBoxes.size());
+    this->Options.Connections = 1;
+    std::atomic<std::size_t> nextMailBox(0);
+    std::vector<std::thread> workers;
+    std::vector<Utils::ReturnCodes> workersReturnCodes(connections, Utils::IMAPCL_SUCCESS);
+    for (unsigned int worker = 1; worker < connections; worker++)
+    {
+        workers.emplace_back([this, worker, headersOnly, newMailOnly, &mailBoxes, &nextMailBox, &workersReturnCodes]() {
+            std::unique_ptr<Session> session = this->CreateWorkerSession();
+            session->WorkerNumber = worker;
+            // Connection refused by the server leaves its mailboxes to the other connections
+            if (session->OpenConnection())
+                return;
+            if ((workersReturnCodes[worker] =
+                     session->FetchListedMailboxes(mailBoxes, nextMailBox, headersOnly, newMailOnly)))
+                return;
+            workersReturnCodes[worker] = session->Logout();
+        });
+    }
+    Utils::ReturnCodes returnCode = this->FetchListedMailboxes(mailBoxes, nextMailBox, headersOnly, newMailOnly);
+    for (auto &worker : workers)
+        worker.join();
+    for (unsigned int worker = 1; worker < connections; worker++)
+        if (!returnCode)
+            returnCode = workersReturnCodes[worker];
+    return this->ReturnCode = returnCode;
 }
 
 Utils::ReturnCodes Session::FetchMail(const bool headersOnly, const bool newMailOnly)
 {
-    if ((this->ReturnCode = this->SelectMailbox()))
+    if ((this->ReturnCode = this->Store->Prepare()))
+    {
+        this->Logout();
+        return this->ReturnCode;
+    }
+    if ((this->ReturnCode = this->SelectMailbox(true)))
         return this->ReturnCode;
-    std::vector<std::string> messageUIDs;
-    if (newMailOnly)
+    UIDSet messageUIDs;
+    // All mail up to the stored modification sequence or UIDNEXT is local, unless it was fetched as headers and
+    // messages are fetched now, so only mail changed or delivered since then is considered
+    bool incremental = !newMailOnly && (headersOnly || !this->StoredHeadersOnly);
+    bool byModSeq = incremental && this->HighestModSeq && this->StoredModSeq;
+    bool byUidNext = incremental && !byModSeq && this->StoredUidNext;
+    // Fetch interrupted by a failed connection continues with what remained and what was delivered since
+    bool resumed = this->Progress.MailBox == this->MailBox && !this->Progress.Validity.empty() &&
+                   this->Progress.Validity == this->MailBoxValidity;
+    if (resumed)
+    {
+        std::tie(messageUIDs, this->ReturnCode) = this->SearchMailboxSince(this->Progress.UidNext);
+        messageUIDs = messageUIDs.Union(this->Progress.RemainingMessageUIDs);
+    }
+    else if (byModSeq && this->QresyncSelected)
+        messageUIDs = this->ChangedMessageUIDs;
+    else if (byModSeq && this->HighestModSeq > this->StoredModSeq)
+        std::tie(messageUIDs, this->ReturnCode) =
+            this->SearchMailbox("MODSEQ " + std::to_string(this->StoredModSeq + 1));
+    // Nothing was delivered if UIDNEXT did not move, servers not announcing it are searched
+    else if (byUidNext && this->UidNext != this->StoredUidNext)
+        std::tie(messageUIDs, this->ReturnCode) = this->SearchMailboxSince(this->StoredUidNext);
+    else if (newMailOnly)
         std::tie(messageUIDs, this->ReturnCode) = this->SearchMailbox("NEW");
-    else
+    else if (!byModSeq && !byUidNext)
         std::tie(messageUIDs, this->ReturnCode) = this->SearchMailbox("ALL");
+    if (byUidNext)
+        this->UidNext = std::max(this->UidNext, this->StoredUidNext);
+    if (resumed)
+        this->UidNext = std::max(this->UidNext, this->Progress.UidNext);
     if (this->ReturnCode == Utils::SOCKET_WRITING)
         return this->ReturnCode;
     else if (this->ReturnCode > 0)
@@ -332,96 +1230,114 @@ Utils::ReturnCodes Session::FetchMail(const bool headersOnly, const bool newMail
         this->Logout();
         return this->ReturnCode;
     }
-    std::vector<std::string> localMessagesUIDs;
-    if (headersOnly)
+    // Unchanged mailbox does not need the local mail index to be loaded
+    UIDSet localMessagesUIDs;
+    if (!messageUIDs.Empty())
+        this->LoadLocalIndex();
+    if (!messageUIDs.Empty() && headersOnly)
         localMessagesUIDs = this->SearchLocalMailDirectoryForAll();
-    else
+    else if (!messageUIDs.Empty())
         localMessagesUIDs = this->SearchLocalMailDirectoryForFullMail();
+    UIDSet missingMessageUIDs = messageUIDs.Difference(localMessagesUIDs);
+    if (!messageUIDs.Empty())
+        this->UidNext = std::max<unsigned long>(this->UidNext, messageUIDs.Highest() + 1UL);
+    unsigned int numOfDownloaded = resumed ? this->Progress.Downloaded : 0;
+    this->Progress = {this->MailBox, this->MailBoxValidity, this->UidNext, missingMessageUIDs, 0};
+    if ((this->ReturnCode = this->FetchMessages(missingMessageUIDs, headersOnly, numOfDownloaded)))
+    {
+        this->Progress.Downloaded = numOfDownloaded;
+        return this->ReturnCode;
+    }
+    this->Progress = {"", "", 0, {}, 0};
+    this->PrintSummary(numOfDownloaded, newMailOnly, headersOnly);
+    if (!newMailOnly)
+        this->SaveSyncState(headersOnly);
+    return Utils::IMAPCL_SUCCESS;
+}
+
+void Session::PrintSummary(unsigned int numOfDownloaded, const bool newMailOnly, const bool headersOnly)
+{
+    // Summary is written at once, so summaries of mailboxes fetched in parallel are not mixed together
+    std::string summary = "Downloaded: " + std::to_string(numOfDownloaded) + (newMailOnly ? " new" : "") +
+                          (headersOnly ? " header(s)" : " message(s)") + " from " + this->MailBox + "\n";
+    std::cout << summary << std::flush;
+}
+
+Utils::ReturnCodes Session::FetchNewMail(const bool headersOnly)
+{
+    UIDSet newMessageUIDs;
+    std::tie(newMessageUIDs, this->ReturnCode) = this->SearchMailboxSince(this->UidNext);
+    if (this->ReturnCode)
+        return this->ReturnCode;
+    if (newMessageUIDs.Empty())
+        return Utils::IMAPCL_SUCCESS;
     unsigned int numOfDownloaded = 0;
-    for (auto x : messageUIDs)
+    if ((this->ReturnCode = this->FetchMessages(newMessageUIDs, headersOnly, numOfDownloaded)))
+        return this->ReturnCode;
+    this->UidNext = std::max<unsigned long>(this->UidNext, newMessageUIDs.Highest() + 1UL);
+    this->PrintSummary(numOfDownloaded, true, headersOnly);
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes Session::WatchMailbox(const bool headersOnly, const volatile std::sig_atomic_t &stopped)
+{
+    if (!this->HasCapability("IDLE"))
+        return Utils::PrintError(Utils::IDLE_NOT_SUPPORTED, "Server does not support IDLE");
+    // Messages delivered between fetching the mailbox and the first IDLE are fetched first
+    bool newMail = true;
+    while (!stopped)
     {
-        bool mailNotToBeDownloaded = false;
-        for (auto m : localMessagesUIDs)
-            if (!x.compare(m))
-                mailNotToBeDownloaded = true;
-        if (mailNotToBeDownloaded)
-            continue;
-        std::unique_ptr<Message> message;
-        if (headersOnly)
-        {
-            // Fetching headers
-            this->SendMessage("UID FETCH " + x + " BODY.PEEK[HEADER]");
+        if (newMail && (this->ReturnCode = this->FetchNewMail(headersOnly)))
+            return this->ReturnCode;
+        newMail = false;
 #ifdef DEBUG
-            std::cerr << "Fetching headers of message with UID: " << x << " in progress...";
+        std::cerr << "Idling..." << std::endl;
 #endif
-            if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+        std::string tag = "A" + std::to_string(this->CurrentTagNumber);
+        if ((this->ReturnCode = this->SendMessage("IDLE")))
+            return this->ReturnCode;
+        // Untagged responses may come before the continuation request
+        do
+        {
+            if ((this->ReturnCode = this->ReceiveResponse()))
                 return this->ReturnCode;
-            if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+            newMail |= Utils::IsExistsResponse(this->Parser.GetLine());
+            if (this->Parser.IsTagged())
             {
                 this->CurrentTagNumber++;
-                this->Logout();
-                return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
+                this->FullResponse = "";
+                return Utils::PrintError(Utils::INVALID_RESPONSE, "Server refused IDLE");
             }
-#ifdef DEBUG
-            std::cerr << " DONE" << std::endl;
-#endif
-            message = std::make_unique<HeaderMessage>(x, this->FullResponse);
-        }
-        else
+        } while (this->Parser.GetTag() != "+");
+        this->FullResponse = "";
+        auto renewal = std::chrono::steady_clock::now() + std::chrono::seconds(IDLE_RENEW_INTERVAL);
+        while (!stopped && !newMail && std::chrono::steady_clock::now() < renewal)
         {
-            // Fetching full messages
-            // Retrieving size of each message
-            this->SendMessage("UID FETCH " + x + " RFC822.SIZE");
-            if ((this->ReturnCode = this->ReceiveTaggedResponse()))
-                return this->ReturnCode;
-            if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+            // Waiting in short steps, so a stop request is noticed while the server is silent
+            auto step = std::min(renewal, std::chrono::steady_clock::now() + std::chrono::seconds(1));
+            if (!this->HasPendingData() && !this->WaitForSocket(false, step))
             {
-                this->CurrentTagNumber++;
-                this->Logout();
-                return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
+                if (errno == EAGAIN)
+                    continue;
+                return Utils::PrintError(Utils::SOCKET_READING, "Failed reading from a socket");
             }
-            std::regex rfcSizeRegex("RFC822.SIZE\\s([0-9]+)", std::regex_constants::icase);
-            std::smatch rfcSizeMatch;
-            std::regex_search(this->FullResponse, rfcSizeMatch, rfcSizeRegex);
-            std::string rfcSize = rfcSizeMatch[1];
-            this->FullResponse = "";
-            this->CurrentTagNumber++;
-            // Fetching mail
-            this->SendMessage("UID FETCH " + x + " BODY[]");
-#ifdef DEBUG
-            std::cerr << "Fetching full message with UID: " << x << " in progress...";
-#endif
-            if ((this->ReturnCode = this->ReceiveTaggedResponse()))
+            if ((this->ReturnCode = this->ReceiveResponse()))
                 return this->ReturnCode;
-            if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
-            {
-                this->CurrentTagNumber++;
-                this->Logout();
-                return Utils::PrintError(Utils::INVALID_RESPONSE, "Invalid response");
-            }
-#ifdef DEBUG
-            std::cerr << " DONE" << std::endl;
-#endif
-            message = std::make_unique<Message>(x, this->FullResponse, stoi(rfcSize));
+            newMail = Utils::IsExistsResponse(this->Parser.GetLine());
+            this->FullResponse = "";
         }
-        message->ParseFileName(this->ServerHostname, this->MailBox);
-        message->ParseMessageBody();
-        message->DumpToFile(this->OutDirectoryPath);
-        this->FullResponse = "";
+        if (this->Send("DONE\r\n", 6) <= 0)
+            return Utils::PrintError(Utils::SOCKET_WRITING, "Failed writing to a socket");
+        do
+        {
+            if ((this->ReturnCode = this->ReceiveResponse()))
+                return this->ReturnCode;
+            newMail |= Utils::IsExistsResponse(this->Parser.GetLine());
+        } while (!this->Parser.IsTagged() || this->Parser.GetTag() != tag);
         this->CurrentTagNumber++;
-        numOfDownloaded++;
-    }
-    if (headersOnly)
-        if (newMailOnly)
-            std::cout << "Downloaded: " << numOfDownloaded << " new header(s) from " << this->MailBox << "\n";
-        else
-            std::cout << "Downloaded: " << numOfDownloaded << " header(s) from " << this->MailBox << "\n";
-    else
-    {
-        if (newMailOnly)
-            std::cout << "Downloaded: " << numOfDownloaded << " new message(s) from " << this->MailBox << "\n";
-        else
-            std::cout << "Downloaded: " << numOfDownloaded << " message(s) from " << this->MailBox << "\n";
+        this->FullResponse = "";
+        if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
+            return Utils::PrintError(Utils::INVALID_RESPONSE, "Response is invalid");
     }
     return Utils::IMAPCL_SUCCESS;
 }
@@ -432,7 +1348,7 @@ Utils::ReturnCodes Session::Logout()
         return this->ReturnCode;
     if ((this->ReturnCode = this->ReceiveTaggedResponse()))
         return this->ReturnCode;
-    if (Utils::ValidateResponse(this->FullResponse, "A" + std::to_string(this->CurrentTagNumber) + "\\sOK"))
+    if (this->Parser.GetStatus() != ResponseParser::STATUS_OK)
         return Utils::PrintError(Utils::INVALID_RESPONSE, "Response is invalid");
     this->FullResponse = "";
     this->CurrentTagNumber++;
@@ -0,0 +1,47 @@
+/**
+ * @file SocketWaiter.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of SocketWaiter class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/SocketWaiter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+
+SocketWaiter::SocketWaiter() : WatchedDescriptor(-1)
+{
+}
+
+bool SocketWaiter::Watch(int descriptor)
+{
+    if (descriptor < 0)
+        return false;
+    this->WatchedDescriptor = descriptor;
+    return true;
+}
+
+SocketWaiter::WaitResult SocketWaiter::Wait(bool write, std::chrono::steady_clock::time_point deadline)
+{
+    // A single descriptor needs no registration, poll() waits for it in one syscall in either direction
+    struct pollfd watched = {this->WatchedDescriptor, static_cast<short>(write ? POLLOUT : POLLIN), 0};
+    while (true)
+    {
+        auto remaining =
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+            return WAIT_TIMED_OUT;
+        // Deadline is clamped to the int timeout of poll(), a longer wait is continued by the loop
+        int ready = poll(&watched, 1, std::min<long>(remaining.count(), INT_MAX));
+        if (ready > 0)
+            return WAIT_READY;
+        if (ready == -1 && errno != EINTR)
+            return WAIT_FAILED;
+    }
+}
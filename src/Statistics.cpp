@@ -0,0 +1,44 @@
+/**
+ * @file Statistics.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of Statistics class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/Statistics.h"
+
+std::atomic<unsigned long> Statistics::Counters[NUM_OF_COUNTERS] = {};
+
+void Statistics::Add(Counter counter, unsigned long value)
+{
+    Counters[counter] += value;
+}
+
+unsigned long Statistics::Get(Counter counter)
+{
+    return Counters[counter];
+}
+
+void Statistics::Print(std::ostream &stream)
+{
+    if (Get(FULL_HANDSHAKES) || Get(RESUMED_HANDSHAKES))
+        stream << "TLS handshakes: " << Get(FULL_HANDSHAKES) << " full, " << Get(RESUMED_HANDSHAKES) << " resumed\n";
+    if (Get(KERNEL_TLS_RECEIVE) || Get(USERSPACE_TLS))
+        stream << "Kernel TLS receive: " << Get(KERNEL_TLS_RECEIVE) << " connection(s), " << Get(USERSPACE_TLS)
+               << " fell back to userspace, " << Get(SPLICED_BYTES) << " byte(s) spliced\n";
+    if (Get(COMPRESSED_BYTES))
+        stream << "Compression: " << Get(COMPRESSED_BYTES) << " byte(s) received on the wire, "
+               << Get(DECOMPRESSED_BYTES) << " byte(s) decompressed ("
+               << (Get(DECOMPRESSED_BYTES) > Get(COMPRESSED_BYTES)
+                       ? 100 - Get(COMPRESSED_BYTES) * 100 / Get(DECOMPRESSED_BYTES)
+                       : 0)
+               << "% saved)\n";
+    if (Get(RECONNECTS))
+        stream << "Reconnects: " << Get(RECONNECTS) << "\n";
+    if (Get(DEDUPLICATED))
+        stream << "Deduplication: " << Get(DEDUPLICATED) << " message(s) linked to stored copies, "
+               << Get(DEDUPLICATED_BYTES) << " byte(s) not stored again\n";
+}
@@ -0,0 +1,145 @@
+/**
+ * @file StreamedMessage.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of StreamedMessage class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/StreamedMessage.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+#include "../include/MessageStore.h"
+#include "../include/Utils.h"
+
+StreamedMessage::StreamedMessage(const std::string &messageUID, const std::string &temporaryFilePath,
+                                 unsigned long rfcSize, bool resumable)
+    : Message(messageUID, "", rfcSize), FilePath(temporaryFilePath), StartOffset(0), Store(nullptr),
+      SpliceDescriptor(-1), Resumable(resumable)
+{
+    if (!resumable)
+    {
+        this->File.open(temporaryFilePath, std::ios::binary | std::ios::trunc);
+        return;
+    }
+    // Opening for reading as well keeps the bytes already stored, the file is created first if there is none
+    std::ofstream(temporaryFilePath, std::ios::binary | std::ios::app).close();
+    this->File.open(temporaryFilePath, std::ios::binary | std::ios::in | std::ios::out);
+    this->File.seekp(0, std::ios::end);
+}
+
+StreamedMessage::StreamedMessage(const std::string &messageUID, MessageStore &store,
+                                 const std::string &temporaryFilePath, unsigned long rfcSize)
+    : Message(messageUID, "", rfcSize), StartOffset(0), Store(&store), SpliceDescriptor(-1), Resumable(false)
+{
+    this->FilePath = store.StreamFilePath(temporaryFilePath, rfcSize, this->StartOffset);
+    if (this->FilePath == temporaryFilePath)
+    {
+        this->File.open(this->FilePath, std::ios::binary | std::ios::trunc);
+        return;
+    }
+    // Body written in place goes to the space the store reserved for it, the rest of the file is kept
+    this->File.open(this->FilePath, std::ios::binary | std::ios::in | std::ios::out);
+    this->File.seekp(this->StartOffset);
+}
+
+StreamedMessage::~StreamedMessage()
+{
+    if (this->SpliceDescriptor >= 0)
+        close(this->SpliceDescriptor);
+    // File is left behind only if the message was not dumped
+    if (this->File.is_open())
+    {
+        this->File.close();
+        // Space the store reserved for the body is as long as the message
+        if (this->Store)
+            this->Store->Discard(this->FilePath, this->StartOffset, this->RfcSize);
+        if (this->Resumable || this->Store)
+            return;
+        std::error_code error;
+        std::filesystem::remove(this->FilePath, error);
+    }
+}
+
+bool StreamedMessage::Write(const char *data, std::size_t length)
+{
+    this->File.write(data, length);
+    return this->File.good();
+}
+
+std::size_t StreamedMessage::GetStoredLength()
+{
+    return static_cast<unsigned long>(this->File.tellp()) - this->StartOffset;
+}
+
+bool StreamedMessage::Flush()
+{
+    return this->File.flush().good();
+}
+
+bool StreamedMessage::Splice(int pipeDescriptor, std::size_t length)
+{
+    // Buffered writes have to reach the file before the spliced data, which is placed right after them
+    if (!this->File.flush())
+        return false;
+    if (this->SpliceDescriptor < 0 && (this->SpliceDescriptor = open(this->FilePath.c_str(), O_WRONLY)) < 0)
+        return false;
+    loff_t offset = this->File.tellp();
+    while (length > 0)
+    {
+        long spliced = splice(pipeDescriptor, nullptr, this->SpliceDescriptor, &offset, length, SPLICE_F_MOVE);
+        if (spliced < 0 && errno == EINTR)
+            continue;
+        if (spliced <= 0)
+            return false;
+        length -= spliced;
+    }
+    // Following writes continue after the spliced data
+    this->File.seekp(offset);
+    return this->File.good();
+}
+
+void StreamedMessage::LoadHeaders()
+{
+    this->File.flush();
+    std::ifstream file(this->FilePath, std::ios::binary);
+    // Headers are looked for only in the message, a file of the store holds other messages after it
+    std::string headers(std::min<std::size_t>(HEADER_SCAN_LIMIT, this->GetStoredLength()), '\0');
+    file.seekg(this->StartOffset);
+    file.read(headers.data(), headers.length());
+    headers.resize(file.gcount());
+    // Only the header section is needed for the file name
+    std::size_t headersEnd = headers.find("\r\n\r\n");
+    if (headersEnd != std::string::npos)
+        headers.resize(headersEnd + 2);
+    this->ResponseString = headers;
+}
+
+void StreamedMessage::ParseFileName(const std::string &serverHostname, const std::string &mailbox)
+{
+    this->LoadHeaders();
+    Message::ParseFileName(serverHostname, mailbox);
+}
+
+void StreamedMessage::ParseMessageBody()
+{
+}
+
+bool StreamedMessage::DumpToFile(MessageStore &store)
+{
+    std::size_t length = this->GetStoredLength();
+    this->File.close();
+    if (this->SpliceDescriptor >= 0)
+        close(this->SpliceDescriptor);
+    this->SpliceDescriptor = -1;
+    if (store.DeliverStreamed(this->FilePath, this->StartOffset, length, this->FileName, false))
+        return true;
+    Utils::PrintError(Utils::MESSAGE_FILE_WRITE, "Failed storing message " + this->MessageUID);
+    return false;
+}
@@ -0,0 +1,240 @@
+/**
+ * @file SyncDaemon.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of SyncDaemon class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/SyncDaemon.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+#include "../include/EncryptedSession.h"
+#include "../include/SecureContextFactory.h"
+#include "../include/Session.h"
+#include "../include/Statistics.h"
+
+volatile std::sig_atomic_t SyncDaemon::Stopped = 0;
+
+SyncDaemon::SyncDaemon(const Utils::Arguments &arguments)
+    : ConfigFilePath(arguments.ConfigFilePath), SyncInterval(arguments.SyncInterval),
+      SyncJitter(arguments.SyncJitter), Workers(arguments.Workers), Random(std::random_device()())
+{
+}
+
+void SyncDaemon::Stop(int signal)
+{
+    (void)signal;
+    Stopped = 1;
+}
+
+Utils::ReturnCodes SyncDaemon::LoadConfig()
+{
+    std::ifstream configFile(this->ConfigFilePath);
+    if (!configFile.is_open())
+        return Utils::PrintError(Utils::CONFIG_FILE_OPEN, "Could not open config file");
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(configFile, line))
+    {
+        lineNumber++;
+        std::vector<std::string> accountArguments = Utils::SplitArguments(line);
+        if (accountArguments.empty() || accountArguments[0][0] == '#')
+            continue;
+        // Account is checked the same way as command line arguments of a single sync
+        accountArguments.insert(accountArguments.begin(), "imapcl");
+        std::vector<char *> args;
+        for (auto &argument : accountArguments)
+            args.push_back(argument.data());
+        args.push_back(nullptr);
+        Utils::Arguments account;
+        // Only 0 makes glibc reinitialize getopt_long, a partly scanned previous account is not carried over
+        optind = 0;
+        // Idling account would occupy its worker for good
+        if (Utils::CheckArguments(args.size() - 1, args.data(), account) || !account.ConfigFilePath.empty() ||
+            account.Idle)
+            return Utils::PrintError(Utils::CONFIG_INVALID_ACCOUNT,
+                                     "Invalid account on line " + std::to_string(lineNumber) + " of the config file");
+        // Certificates are loaded up front, so invalid ones stop the daemon before the first sync
+        if (account.Encrypted)
+        {
+            SSL_CTX *secureContext = nullptr;
+            Utils::ReturnCodes returnCode = SecureContextFactory::Acquire(
+                account.CertificateFile, account.CertificateFileDirectoryPath, secureContext);
+            if (returnCode)
+                return returnCode;
+            SSL_CTX_free(secureContext);
+        }
+        this->Accounts.push_back(account);
+    }
+    if (this->Accounts.empty())
+        return Utils::PrintError(Utils::CONFIG_INVALID_ACCOUNT, "No accounts in the config file");
+    return Utils::IMAPCL_SUCCESS;
+}
+
+std::chrono::steady_clock::time_point SyncDaemon::ScheduleTime(unsigned int maximumDelay, unsigned int minimumDelay)
+{
+    std::uniform_int_distribution<unsigned long> delay(minimumDelay * 1000UL, maximumDelay * 1000UL);
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(delay(this->Random));
+}
+
+void SyncDaemon::RunWorker()
+{
+    std::unique_lock<std::mutex> lock(this->ScheduleMutex);
+    while (!Stopped)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (this->Schedule.empty() || this->Schedule.front().Time > now)
+        {
+            // Waking up at least every second to check whether the daemon was stopped
+            auto wakeUp = now + std::chrono::seconds(1);
+            if (!this->Schedule.empty())
+                wakeUp = std::min(wakeUp, this->Schedule.front().Time);
+            this->ScheduleChanged.wait_until(lock, wakeUp);
+            continue;
+        }
+        auto later = [](const ScheduledSync &a, const ScheduledSync &b) { return a.Time > b.Time; };
+        std::pop_heap(this->Schedule.begin(), this->Schedule.end(), later);
+        ScheduledSync sync = this->Schedule.back();
+        this->Schedule.pop_back();
+        lock.unlock();
+        SyncAccount(this->Accounts[sync.Account]);
+        lock.lock();
+        // Account is out of the schedule while it is synced, so it is never synced by two workers at once
+        sync.Time = this->ScheduleTime(this->SyncInterval + this->SyncJitter, this->SyncInterval);
+        this->Schedule.push_back(sync);
+        std::push_heap(this->Schedule.begin(), this->Schedule.end(), later);
+        this->ScheduleChanged.notify_one();
+    }
+}
+
+Utils::ReturnCodes SyncDaemon::Run()
+{
+    std::signal(SIGINT, Stop);
+    std::signal(SIGTERM, Stop);
+    // Connection closed by a server must not terminate the whole daemon
+    std::signal(SIGPIPE, SIG_IGN);
+    {
+        // First syncs are spread over the interval, so the accounts are not all synced at once
+        std::lock_guard<std::mutex> lock(this->ScheduleMutex);
+        for (std::size_t account = 0; account < this->Accounts.size(); account++)
+            this->Schedule.push_back({this->ScheduleTime(this->SyncInterval, 0), account});
+        std::make_heap(this->Schedule.begin(), this->Schedule.end(),
+                       [](const ScheduledSync &a, const ScheduledSync &b) { return a.Time > b.Time; });
+    }
+    std::vector<std::thread> workers;
+    for (unsigned int worker = 0; worker < this->Workers; worker++)
+        workers.emplace_back(&SyncDaemon::RunWorker, this);
+    for (auto &worker : workers)
+        worker.join();
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes SyncDaemon::RunSession(const Utils::Arguments &account, Session &session, bool &authenticated)
+{
+    Utils::ReturnCodes returnCode;
+    if ((returnCode = session.GetHostAddressInfo()))
+        return returnCode;
+    if ((returnCode = session.Connect()))
+        return returnCode;
+#ifdef DEBUG
+    std::cerr << "Authenticating...";
+#endif
+    if ((returnCode = session.Authenticate()))
+        return returnCode;
+    authenticated = true;
+#ifdef DEBUG
+    std::cerr << " DONE" << std::endl;
+#endif
+#ifdef DEBUG
+    std::cerr << "Fetching..." << std::endl;
+#endif
+    if (!account.MailBoxPattern.empty())
+        returnCode = session.FetchMailboxes(account.MailBoxPattern, account.OnlyMailHeaders, account.OnlyNewMails);
+    else
+        returnCode = session.FetchMail(account.OnlyMailHeaders, account.OnlyNewMails);
+    if (returnCode)
+        return returnCode;
+#ifdef DEBUG
+    std::cerr << "Fetching DONE" << std::endl;
+#endif
+    if (account.Idle)
+    {
+        // Watching is stopped by the same signals as the daemon, so the session is logged out
+        std::signal(SIGINT, Stop);
+        std::signal(SIGTERM, Stop);
+        if ((returnCode = session.WatchMailbox(account.OnlyMailHeaders, Stopped)))
+            return returnCode;
+    }
+#ifdef DEBUG
+    std::cerr << "Logging out...";
+#endif
+    if ((returnCode = session.Logout()))
+        return returnCode;
+#ifdef DEBUG
+    std::cerr << " DONE" << std::endl;
+#endif
+    return Utils::IMAPCL_SUCCESS;
+}
+
+Utils::ReturnCodes SyncDaemon::SyncAccount(const Utils::Arguments &account)
+{
+    Utils::ReturnCodes returnCode;
+    Session::SyncProgress progress = {"", "", 0, {}, 0};
+    unsigned int reconnects = 0;
+    unsigned int failures = 0;  // Failed connections in a row
+    bool authenticated = false; // Server was reached and accepted the credentials at least once
+    // Connection closed by the server has to be reported by the failed write, so the sync can reconnect
+    std::signal(SIGPIPE, SIG_IGN);
+    while (true)
+    {
+        std::unique_ptr<Session> session;
+        if (account.Encrypted)
+            session = std::make_unique<EncryptedSession>(account.ServerAddress, account.Port, account.Username,
+                                                         account.Password, account.OutDirectoryPath, account.MailBox,
+                                                         account.CertificateFile, account.CertificateFileDirectoryPath,
+                                                         account.Options);
+        else
+            session = std::make_unique<Session>(account.ServerAddress, account.Port, account.Username,
+                                                account.Password, account.OutDirectoryPath, account.MailBox,
+                                                account.Options);
+        session->ResumeProgress(progress);
+        auto started = std::chrono::steady_clock::now();
+        returnCode = RunSession(account, *session, authenticated);
+        // Server that can not be reached in the first place (i.e. a mistyped host or port) is reported right away
+        if (!Utils::IsConnectionError(returnCode) || !authenticated || Stopped)
+            break;
+        // Connection which lasted longer than the longest delay starts the backoff over
+        if (std::chrono::steady_clock::now() - started > std::chrono::seconds(RECONNECT_MAX_DELAY))
+            failures = 0;
+        if (failures >= account.Options.Reconnects)
+            break;
+        progress = session->GetProgress();
+        session.reset();
+        auto delay =
+            std::chrono::seconds(std::min(RECONNECT_BASE_DELAY << std::min(failures, 16U), RECONNECT_MAX_DELAY));
+        failures++;
+#ifdef DEBUG
+        std::cerr << "Reconnecting in " << delay.count() << " second(s)..." << std::endl;
+#endif
+        // Waiting in short steps, so a stop request is noticed during the delay
+        auto reconnectTime = std::chrono::steady_clock::now() + delay;
+        while (!Stopped && std::chrono::steady_clock::now() < reconnectTime)
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                reconnectTime - std::chrono::steady_clock::now(), std::chrono::milliseconds(100)));
+        if (Stopped)
+            break;
+        reconnects++;
+        Statistics::Add(Statistics::RECONNECTS);
+    }
+    if (reconnects)
+        std::cout << "Reconnected: " + std::to_string(reconnects) + " time(s) to " + account.ServerAddress + "\n"
+                  << std::flush;
+    return returnCode;
+}
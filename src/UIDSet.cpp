@@ -0,0 +1,200 @@
+/**
+ * @file UIDSet.cpp
+ * @author  Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Contains definitions of UIDSet class methods
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "../include/UIDSet.h"
+
+#include <algorithm>
+#include <cctype>
+
+UIDSet::UIDSet()
+{
+}
+
+UIDSet::UIDSet(std::vector<uint32_t> uids)
+{
+    std::sort(uids.begin(), uids.end());
+    for (uint32_t uid : uids)
+        this->Append(uid, uid);
+}
+
+UIDSet::UIDSet(const std::vector<std::string> &messageUIDs)
+{
+    std::vector<uint32_t> uids;
+    uids.reserve(messageUIDs.size());
+    uint32_t uid;
+    for (const auto &messageUID : messageUIDs)
+        if (ParseUID(messageUID, uid))
+            uids.push_back(uid);
+    *this = UIDSet(std::move(uids));
+}
+
+bool UIDSet::ParseUID(const std::string &text, uint32_t &uid)
+{
+    if (text.empty() || text.length() > 10 ||
+        !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c); }))
+        return false;
+    unsigned long long value = std::stoull(text);
+    if (value > UINT32_MAX)
+        return false;
+    uid = static_cast<uint32_t>(value);
+    return true;
+}
+
+void UIDSet::Append(uint32_t first, uint32_t last)
+{
+    if (!this->Intervals.empty() && static_cast<uint64_t>(first) <= this->Intervals.back().Last + 1ULL)
+        this->Intervals.back().Last = std::max(this->Intervals.back().Last, last);
+    else
+        this->Intervals.push_back({first, last});
+}
+
+void UIDSet::Insert(uint32_t first, uint32_t last)
+{
+    // UIDs mostly come in ascending order
+    if (this->Intervals.empty() || first >= this->Intervals.back().First)
+    {
+        this->Append(first, last);
+        return;
+    }
+    // First interval touching the inserted one and the first one after it
+    auto start = std::lower_bound(this->Intervals.begin(), this->Intervals.end(), first,
+                                  [](const Interval &interval, uint32_t uid) { return interval.Last + 1ULL < uid; });
+    auto end = start;
+    while (end != this->Intervals.end() && end->First <= last + 1ULL)
+    {
+        first = std::min(first, end->First);
+        last = std::max(last, end->Last);
+        end++;
+    }
+    start = this->Intervals.erase(start, end);
+    this->Intervals.insert(start, {first, last});
+}
+
+void UIDSet::Insert(uint32_t uid)
+{
+    this->Insert(uid, uid);
+}
+
+void UIDSet::Erase(uint32_t uid)
+{
+    auto interval = std::lower_bound(this->Intervals.begin(), this->Intervals.end(), uid,
+                                     [](const Interval &interval, uint32_t uid) { return interval.Last < uid; });
+    if (interval == this->Intervals.end() || interval->First > uid)
+        return;
+    if (interval->First == interval->Last)
+        this->Intervals.erase(interval);
+    else if (interval->First == uid)
+        interval->First++;
+    else if (interval->Last == uid)
+        interval->Last--;
+    else
+    {
+        // UID in the middle splits the interval
+        Interval lower = {interval->First, uid - 1};
+        interval->First = uid + 1;
+        this->Intervals.insert(interval, lower);
+    }
+}
+
+bool UIDSet::Contains(uint32_t uid) const
+{
+    auto interval = std::lower_bound(this->Intervals.begin(), this->Intervals.end(), uid,
+                                     [](const Interval &interval, uint32_t uid) { return interval.Last < uid; });
+    return interval != this->Intervals.end() && interval->First <= uid;
+}
+
+UIDSet UIDSet::Union(const UIDSet &other) const
+{
+    UIDSet result;
+    auto left = this->Intervals.begin();
+    auto right = other.Intervals.begin();
+    while (left != this->Intervals.end() || right != other.Intervals.end())
+    {
+        if (right == other.Intervals.end() || (left != this->Intervals.end() && left->First < right->First))
+        {
+            result.Append(left->First, left->Last);
+            left++;
+        }
+        else
+        {
+            result.Append(right->First, right->Last);
+            right++;
+        }
+    }
+    return result;
+}
+
+UIDSet UIDSet::Difference(const UIDSet &other) const
+{
+    UIDSet result;
+    auto removed = other.Intervals.begin();
+    for (const auto &interval : this->Intervals)
+    {
+        uint64_t first = interval.First;
+        // Intervals of the other set are visited once, they are sorted the same way
+        while (removed != other.Intervals.end() && removed->Last < first)
+            removed++;
+        for (auto cut = removed; cut != other.Intervals.end() && cut->First <= interval.Last; cut++)
+        {
+            if (cut->First > first)
+                result.Intervals.push_back({static_cast<uint32_t>(first), cut->First - 1});
+            first = cut->Last + 1ULL;
+            if (first > interval.Last)
+                break;
+        }
+        if (first <= interval.Last)
+            result.Intervals.push_back({static_cast<uint32_t>(first), interval.Last});
+    }
+    return result;
+}
+
+std::size_t UIDSet::Size() const
+{
+    std::size_t size = 0;
+    for (const auto &interval : this->Intervals)
+        size += static_cast<std::size_t>(interval.Last - interval.First) + 1;
+    return size;
+}
+
+bool UIDSet::Empty() const
+{
+    return this->Intervals.empty();
+}
+
+uint32_t UIDSet::Highest() const
+{
+    return this->Intervals.empty() ? 0 : this->Intervals.back().Last;
+}
+
+std::string UIDSet::ToSequenceSet() const
+{
+    std::string sequenceSet;
+    for (const auto &interval : this->Intervals)
+    {
+        if (!sequenceSet.empty())
+            sequenceSet += ",";
+        sequenceSet += std::to_string(interval.First);
+        if (interval.Last != interval.First)
+            sequenceSet += ":" + std::to_string(interval.Last);
+    }
+    return sequenceSet;
+}
+
+const std::vector<UIDSet::Interval> &UIDSet::GetIntervals() const
+{
+    return this->Intervals;
+}
+
+bool UIDSet::operator==(const UIDSet &other) const
+{
+    return this->Intervals.size() == other.Intervals.size() &&
+           std::equal(this->Intervals.begin(), this->Intervals.end(), other.Intervals.begin(),
+                      [](const Interval &a, const Interval &b) { return a.First == b.First && a.Last == b.Last; });
+}
@@ -9,8 +9,9 @@
  *
  */
 
-#include "../include/EncryptedSession.h"
-#include "../include/Session.h"
+#include "../include/MessageStore.h"
+#include "../include/Statistics.h"
+#include "../include/SyncDaemon.h"
 #include "../include/Utils.h"
 
 int main(int argc, char **argv)
@@ -19,44 +20,18 @@ int main(int argc, char **argv)
     Utils::ReturnCodes returnCode;
     if ((returnCode = Utils::CheckArguments(argc, argv, arguments)))
         return returnCode;
-    std::unique_ptr<Session> session;
-    if (arguments.Encrypted)
-        session = std::make_unique<EncryptedSession>(arguments.ServerAddress, arguments.Port, arguments.Username,
-                                                     arguments.Password, arguments.OutDirectoryPath, arguments.MailBox,
-                                                     arguments.CertificateFile, arguments.CertificateFileDirectoryPath);
+    if (!arguments.ExtractPath.empty())
+        return ArchiveStore(arguments.ExtractPath).Extract(arguments.ExtractNames, arguments.OutDirectoryPath);
+    if (arguments.ConfigFilePath.empty())
+        returnCode = SyncDaemon::SyncAccount(arguments);
     else
-        session = std::make_unique<Session>(arguments.ServerAddress, arguments.Port, arguments.Username,
-                                            arguments.Password, arguments.OutDirectoryPath, arguments.MailBox);
-
-    if ((returnCode = session->GetHostAddressInfo()))
-        return returnCode;
-    if ((returnCode = session->CreateSocket()))
-        return returnCode;
-    if ((returnCode = session->Connect()))
-        return returnCode;
-#ifdef DEBUG
-    std::cerr << "Authenticating...";
-#endif
-    if ((returnCode = session->Authenticate()))
-        return returnCode;
-#ifdef DEBUG
-    std::cerr << " DONE" << std::endl;
-#endif
-#ifdef DEBUG
-    std::cerr << "Fetching..." << std::endl;
-#endif
-    if ((returnCode = session->FetchMail(arguments.OnlyMailHeaders, arguments.OnlyNewMails)))
-        return returnCode;
-#ifdef DEBUG
-    std::cerr << "Fetching DONE" << std::endl;
-#endif
-#ifdef DEBUG
-    std::cerr << "Logging out...";
-#endif
-    if ((returnCode = session->Logout()))
-        return returnCode;
-#ifdef DEBUG
-    std::cerr << " DONE" << std::endl;
-#endif
-    return Utils::IMAPCL_SUCCESS;
+    {
+        SyncDaemon daemon(arguments);
+        if ((returnCode = daemon.LoadConfig()))
+            return returnCode;
+        returnCode = daemon.Run();
+    }
+    if (arguments.PrintStatistics)
+        Statistics::Print(std::cout);
+    return returnCode;
 }
@@ -0,0 +1,109 @@
+/**
+ * @file benchmark.cpp
+ * @author Matúš Ďurica (xduric06@stud.fit.vutbr.cz)
+ * @brief Benchmark of reconciling remote and local mail UIDs
+ * @version 0.1
+ * @date 2024-10-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../../include/UIDSet.h"
+
+#define BENCHMARK_UIDS 1000000      // UIDs in the remote mailbox
+#define BENCHMARK_NESTED_UIDS 5000  // UIDs compared by the nested loop, it is quadratic
+#define BENCHMARK_NEW_MAIL 1000     // Messages delivered since the last sync
+
+/**
+ * @brief Build remote and local UIDs of a mailbox: every hundredth message was expunged and the newest messages are
+ * not local yet
+ *
+ * @param numOfUIDs Number of UIDs in the remote mailbox
+ * @param remote Remote UIDs as found by SEARCH
+ * @param local Local UIDs
+ */
+static void BuildMailbox(unsigned int numOfUIDs, std::vector<std::string> &remote, std::vector<std::string> &local)
+{
+    for (unsigned int uid = 1; remote.size() < numOfUIDs; uid++)
+    {
+        if (uid % 100 == 0)
+            continue;
+        remote.push_back(std::to_string(uid));
+        if (remote.size() <= numOfUIDs - BENCHMARK_NEW_MAIL)
+            local.push_back(std::to_string(uid));
+    }
+}
+
+/**
+ * @brief Measure milliseconds taken by a function
+ *
+ * @param function Measured function
+ */
+template <typename Function> static double Measure(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int numOfUIDs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : BENCHMARK_UIDS;
+    unsigned int numOfNestedUIDs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : BENCHMARK_NESTED_UIDS;
+    std::size_t missing = 0;
+
+    // Nested loop comparing strings, measured on a smaller mailbox and extrapolated
+    std::vector<std::string> remote;
+    std::vector<std::string> local;
+    BuildMailbox(numOfNestedUIDs, remote, local);
+    double nestedTime = Measure([&]() {
+        std::vector<std::string> missingUIDs;
+        for (const auto &x : remote)
+        {
+            bool found = false;
+            for (const auto &m : local)
+                if (!x.compare(m))
+                    found = true;
+            if (!found)
+                missingUIDs.push_back(x);
+        }
+        missing = missingUIDs.size();
+    });
+    double scale = static_cast<double>(numOfUIDs) / numOfNestedUIDs;
+    std::cout << "Nested loop (" << numOfNestedUIDs << " UIDs): " << nestedTime << " ms, " << missing
+              << " missing, extrapolated to " << numOfUIDs << " UIDs: " << nestedTime * scale * scale / 1000 << " s"
+              << std::endl;
+
+    remote.clear();
+    local.clear();
+    BuildMailbox(numOfUIDs, remote, local);
+    double hashTime = Measure([&]() {
+        std::unordered_set<std::string> localUIDs(local.begin(), local.end());
+        std::vector<std::string> missingUIDs;
+        for (const auto &x : remote)
+            if (!localUIDs.count(x))
+                missingUIDs.push_back(x);
+        missing = missingUIDs.size();
+    });
+    std::cout << "Hash set (" << numOfUIDs << " UIDs): " << hashTime << " ms, " << missing << " missing"
+              << std::endl;
+
+    UIDSet remoteUIDs;
+    UIDSet localUIDs;
+    double buildTime = Measure([&]() {
+        remoteUIDs = UIDSet(remote);
+        localUIDs = UIDSet(local);
+    });
+    double differenceTime = Measure([&]() { missing = remoteUIDs.Difference(localUIDs).Size(); });
+    std::cout << "UID set (" << numOfUIDs << " UIDs): " << buildTime << " ms to build from strings, "
+              << differenceTime << " ms difference, " << missing << " missing, "
+              << remoteUIDs.GetIntervals().size() << " intervals" << std::endl;
+    return EXIT_SUCCESS;
+}
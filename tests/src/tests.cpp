@@ -8,10 +8,25 @@
  * @copyright Copyright (c) 2024
  *
  */
+#include <climits>
 #include <cstdlib>
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
+#include "../../include/ConnectionRace.h"
+#include "../../include/DeflateStream.h"
+#include "../../include/SocketWaiter.h"
+#include "../../include/FetchQueue.h"
+#include "../../include/LocalIndex.h"
+#include "../../include/MessageStore.h"
+#include "../../include/ResponseParser.h"
+#include "../../include/SecureContextFactory.h"
 #include "../../include/Session.h"
+#include "../../include/StreamedMessage.h"
+#include "../../include/UIDSet.h"
 #include "../../include/Utils.h"
 
 using namespace Utils;
@@ -236,6 +251,168 @@ TEST(ArgumentsMissingOptions, MissingOptionPortEnd)
     ASSERT_EQ(Utils::ARGS_MISSING_OPTION, Utils::CheckArguments(numOfArguments, args, arguments));
 }
 
+TEST(Arguments, PipelineDepth)
+{
+    int numOfArguments = 8;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a", (char *)"./tests/resources/example.txt",
+                    (char *)"-o",       (char *)"/dev/null",      (char *)"--pipeline", (char *)"16",
+                    nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(numOfArguments, args, arguments));
+    ASSERT_EQ(16, arguments.Options.PipelineDepth);
+}
+
+TEST(Arguments, InvalidPipelineDepth)
+{
+    int numOfArguments = 8;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a", (char *)"./tests/resources/example.txt",
+                    (char *)"-o",       (char *)"/dev/null",      (char *)"--pipeline", (char *)"0",
+                    nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::ARGS_INVALID_VALUE, Utils::CheckArguments(numOfArguments, args, arguments));
+}
+
+TEST(Arguments, Connections)
+{
+    int numOfArguments = 8;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a", (char *)"./tests/resources/example.txt",
+                    (char *)"-o",       (char *)"/dev/null",      (char *)"--connections", (char *)"4",
+                    nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(numOfArguments, args, arguments));
+    ASSERT_EQ(4, arguments.Options.Connections);
+}
+
+TEST(Arguments, Reconnects)
+{
+    int numOfArguments = 8;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a", (char *)"./tests/resources/example.txt",
+                    (char *)"-o",       (char *)"/dev/null",      (char *)"--reconnects", (char *)"0",
+                    nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(5, arguments.Options.Reconnects);
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(numOfArguments, args, arguments));
+    ASSERT_EQ(0, arguments.Options.Reconnects);
+    ASSERT_TRUE(Utils::IsConnectionError(Utils::CONNECTION_CLOSED));
+    ASSERT_FALSE(Utils::IsConnectionError(Utils::AUTH_INVALID_CREDENTIALS));
+}
+
+TEST(Arguments, Timeout)
+{
+    int numOfArguments = 8;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a", (char *)"./tests/resources/example.txt",
+                    (char *)"-o",       (char *)"/dev/null",      (char *)"--timeout", (char *)"86400",
+                    nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(numOfArguments, args, arguments));
+    ASSERT_EQ(86400, arguments.Options.Timeout);
+    char *invalidArgs[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a",
+                           (char *)"./tests/resources/example.txt", (char *)"-o", (char *)"/dev/null",
+                           (char *)"--timeout", (char *)"4294967295", nullptr};
+    optind = 1;
+    ASSERT_EQ(Utils::ARGS_INVALID_VALUE, Utils::CheckArguments(numOfArguments, invalidArgs, arguments));
+}
+
+TEST(Arguments, Store)
+{
+    int numOfArguments = 8;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a", (char *)"./tests/resources/example.txt",
+                    (char *)"-o",       (char *)"/dev/null",      (char *)"--store", (char *)"maildir",
+                    nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::STORE_FLAT, arguments.Options.Store);
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(numOfArguments, args, arguments));
+    ASSERT_EQ(Utils::STORE_MAILDIR, arguments.Options.Store);
+    char *invalidArgs[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a",
+                           (char *)"./tests/resources/example.txt", (char *)"-o", (char *)"/dev/null",
+                           (char *)"--store", (char *)"mbox", nullptr};
+    optind = 1;
+    ASSERT_EQ(Utils::ARGS_INVALID_VALUE, Utils::CheckArguments(numOfArguments, invalidArgs, arguments));
+    // Extracting from an archive needs neither a server nor an auth file
+    char *extractArgs[] = {(char *)"./imapcl", (char *)"--extract", (char *)"/tmp", (char *)"-o",
+                           (char *)"/dev/null", (char *)"42",       nullptr};
+    optind = 1;
+    Utils::Arguments extractArguments;
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(6, extractArgs, extractArguments));
+    ASSERT_EQ("/tmp", extractArguments.ExtractPath);
+    ASSERT_EQ(std::vector<std::string>{"42"}, extractArguments.ExtractNames);
+    // Second server is refused
+    char *twoServers[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a",
+                          (char *)"./tests/resources/example.txt", (char *)"-o", (char *)"/dev/null",
+                          (char *)"other.server", nullptr};
+    optind = 1;
+    Utils::Arguments serverArguments;
+    ASSERT_EQ(Utils::ARGS_UNKNOWN_ARGUMENT, Utils::CheckArguments(7, twoServers, serverArguments));
+    ASSERT_TRUE(serverArguments.ExtractNames.empty());
+}
+
+TEST(Arguments, Daemon)
+{
+    int numOfArguments = 7;
+    char *args[] = {(char *)"./imapcl",   (char *)"--daemon", (char *)"./tests/resources/example.txt",
+                    (char *)"--interval", (char *)"60",       (char *)"--jitter",
+                    (char *)"0",          nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(numOfArguments, args, arguments));
+    ASSERT_EQ("./tests/resources/example.txt", arguments.ConfigFilePath);
+    ASSERT_EQ(60, arguments.SyncInterval);
+    ASSERT_EQ(0, arguments.SyncJitter);
+}
+
+TEST(Arguments, TlsCache)
+{
+    int numOfArguments = 10;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-T", (char *)"-a",
+                    (char *)"./tests/resources/example.txt", (char *)"-o", (char *)"/dev/null",
+                    (char *)"--tls-cache", (char *)"./nonexistent/", (char *)"--stats", nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::ARGS_INVALID_VALUE, Utils::CheckArguments(numOfArguments, args, arguments));
+    char *validArgs[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-T", (char *)"-a",
+                         (char *)"./tests/resources/example.txt", (char *)"-o", (char *)"/dev/null",
+                         (char *)"--tls-cache", (char *)"./tests/", (char *)"--stats", nullptr};
+    optind = 1;
+    arguments = Utils::Arguments();
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, Utils::CheckArguments(numOfArguments, validArgs, arguments));
+    ASSERT_EQ("./tests/", arguments.Options.TlsCachePath);
+    ASSERT_TRUE(arguments.PrintStatistics);
+}
+
+TEST(Arguments, SplitConfigLine)
+{
+    std::vector<std::string> splitArguments = Utils::SplitArguments("  imap.server -a \"auth file.txt\"\t-o out ");
+    ASSERT_EQ(5, splitArguments.size());
+    ASSERT_EQ("imap.server", splitArguments[0]);
+    ASSERT_EQ("auth file.txt", splitArguments[2]);
+    ASSERT_EQ("out", splitArguments[4]);
+}
+
+TEST(ArgumentsMissingOptions, MissingOptionPipelineEnd)
+{
+    int numOfArguments = 7;
+    char *args[] = {(char *)"./imapcl", (char *)"example.server", (char *)"-a", (char *)"./tests/resources/example/",
+                    (char *)"-o",       (char *)"/dev/null",      (char *)"--pipeline", nullptr};
+    // Reset optind before each test run
+    optind = 1;
+    Utils::Arguments arguments;
+    ASSERT_EQ(Utils::ARGS_MISSING_OPTION, Utils::CheckArguments(numOfArguments, args, arguments));
+}
+
 TEST(AuthenticationFile, MissingUsername)
 {
     int numOfArguments = 6;
@@ -286,6 +463,637 @@ TEST(AuthenticationFile, SpacesInPassword)
     ASSERT_EQ("test test", arguments.Password);
 }
 
+TEST(ResponseParser, TaggedCompletion)
+{
+    ResponseParser parser;
+    std::string response = "* 2 EXISTS\r\nA3 OK SELECT completed\r\n";
+    std::size_t consumed = parser.Feed(response.data(), response.length());
+    ASSERT_TRUE(parser.IsResponseComplete());
+    ASSERT_FALSE(parser.IsTagged());
+    ASSERT_EQ(ResponseParser::STATUS_NONE, parser.GetStatus());
+    consumed += parser.Feed(response.data() + consumed, response.length() - consumed);
+    ASSERT_EQ(response.length(), consumed);
+    ASSERT_TRUE(parser.IsResponseComplete());
+    ASSERT_TRUE(parser.IsTagged());
+    ASSERT_EQ("A3", parser.GetTag());
+    ASSERT_EQ(ResponseParser::STATUS_OK, parser.GetStatus());
+}
+
+TEST(ResponseParser, SplitAcrossReads)
+{
+    ResponseParser parser;
+    std::string response = "A12 no [AUTHENTICATIONFAILED] Invalid credentials\r\n";
+    for (char c : response)
+        ASSERT_EQ(1, parser.Feed(&c, 1));
+    ASSERT_TRUE(parser.IsResponseComplete());
+    ASSERT_EQ("A12", parser.GetTag());
+    ASSERT_EQ(ResponseParser::STATUS_NO, parser.GetStatus());
+}
+
+TEST(ResponseParser, LiteralIsSkipped)
+{
+    ResponseParser parser;
+    std::string response = "* 1 FETCH (UID 7 BODY[] {20}\r\nA1 OK fake\r\n\r\nbody\r\n)\r\nA1 OK done\r\n";
+    std::size_t consumed = parser.Feed(response.data(), response.length());
+    ASSERT_TRUE(parser.IsLineReady());
+    ASSERT_FALSE(parser.IsResponseComplete());
+    ASSERT_EQ(20, parser.GetLiteralSize());
+    ASSERT_TRUE(parser.InLiteral());
+    consumed += parser.Feed(response.data() + consumed, response.length() - consumed);
+    ASSERT_FALSE(parser.InLiteral());
+    ASSERT_FALSE(parser.IsResponseComplete());
+    consumed += parser.Feed(response.data() + consumed, response.length() - consumed);
+    ASSERT_TRUE(parser.IsResponseComplete());
+    ASSERT_FALSE(parser.IsTagged());
+    ASSERT_EQ(")", parser.GetLine());
+    consumed += parser.Feed(response.data() + consumed, response.length() - consumed);
+    ASSERT_EQ(response.length(), consumed);
+    ASSERT_TRUE(parser.IsResponseComplete());
+    ASSERT_EQ("A1", parser.GetTag());
+    ASSERT_EQ(ResponseParser::STATUS_OK, parser.GetStatus());
+}
+
+TEST(ResponseParser, SplicedLiteral)
+{
+    ResponseParser parser;
+    std::string response = "* 1 FETCH (UID 7 BODY[] {20}\r\n";
+    parser.Feed(response.data(), response.length());
+    ASSERT_EQ(15, parser.SkipLiteral(15));
+    ASSERT_FALSE(parser.IsLineReady());
+    ASSERT_EQ(5, parser.GetLiteralRemaining());
+    ASSERT_EQ(5, parser.SkipLiteral(64));
+    ASSERT_FALSE(parser.InLiteral());
+    response = ")\r\n";
+    parser.Feed(response.data(), response.length());
+    ASSERT_TRUE(parser.IsResponseComplete());
+}
+
+TEST(ResponseParser, OversizedLiteral)
+{
+    ResponseParser parser;
+    std::string response = "* 1 FETCH (UID 7 BODY[] {18446744073709551616}\r\nA1 OK done\r\n";
+    std::size_t consumed = parser.Feed(response.data(), response.length());
+    ASSERT_TRUE(parser.IsMalformed());
+    ASSERT_FALSE(parser.InLiteral());
+    ASSERT_FALSE(parser.IsResponseComplete());
+    parser.Feed(response.data() + consumed, response.length() - consumed);
+    ASSERT_TRUE(parser.IsMalformed());
+    ASSERT_FALSE(parser.IsResponseComplete());
+    parser.Reset();
+    response = "* 1 FETCH (UID 7 BODY[] {18446744073709551615}\r\n";
+    parser.Feed(response.data(), response.length());
+    ASSERT_FALSE(parser.IsMalformed());
+    ASSERT_EQ(ULONG_MAX, parser.GetLiteralSize());
+}
+
+TEST(ResponseParser, UntaggedGreeting)
+{
+    ResponseParser parser;
+    std::string response = "* OK [CAPABILITY IMAP4rev1] Server ready\r\n";
+    parser.Feed(response.data(), response.length());
+    ASSERT_TRUE(parser.IsResponseComplete());
+    ASSERT_FALSE(parser.IsTagged());
+    ASSERT_EQ(ResponseParser::STATUS_OK, parser.GetStatus());
+}
+
+TEST(FetchResponse, ExtractItems)
+{
+    std::string line = "* 12 FETCH (FLAGS (\\Seen) UID 4827313 RFC822.SIZE 44827 BODY[] {44827}";
+    ASSERT_EQ("4827313", Utils::ExtractFetchItem(line, "UID"));
+    ASSERT_EQ("44827", Utils::ExtractFetchItem(line, "rfc822.size"));
+    ASSERT_EQ("", Utils::ExtractFetchItem(line, "MODSEQ"));
+    ASSERT_EQ("BODY[]", Utils::ExtractLiteralItem(line));
+    ASSERT_EQ("BODY[HEADER]", Utils::ExtractLiteralItem("* 1 FETCH (BODY[HEADER] {342}"));
+    ASSERT_EQ("7", Utils::ExtractFetchItem("* 3 FETCH (UID 7)", "UID"));
+}
+
+TEST(FetchResponse, SequenceSet)
+{
+    ASSERT_EQ("1:3,5,7:8", UIDSet(std::vector<uint32_t>{1, 2, 3, 5, 7, 8}).ToSequenceSet());
+    ASSERT_EQ("42", UIDSet(std::vector<uint32_t>{42}).ToSequenceSet());
+    ASSERT_EQ("", UIDSet().ToSequenceSet());
+    ASSERT_EQ(std::string("1:500,").length(), Utils::SequenceRangeLength(1, 500));
+    ASSERT_EQ(std::string("42,").length(), Utils::SequenceRangeLength(42, 42));
+}
+
+TEST(ListResponse, MailboxNames)
+{
+    std::string response = "* LIST (\\HasNoChildren) \"/\" INBOX\r\n"
+                           "* LIST (\\Noselect \\HasChildren) \"/\" \"[Gmail]\"\r\n"
+                           "* LIST (\\HasNoChildren) \"/\" \"[Gmail]/Sent \\\"Mail\\\"\"\r\n"
+                           "* LIST () NIL {7}\r\nArchive\r\n"
+                           "A2 OK LIST completed\r\n";
+    std::vector<std::string> mailBoxes = Utils::ParseListResponse(response);
+    ASSERT_EQ(3, mailBoxes.size());
+    ASSERT_EQ("INBOX", mailBoxes[0]);
+    ASSERT_EQ("[Gmail]/Sent \"Mail\"", mailBoxes[1]);
+    ASSERT_EQ("Archive", mailBoxes[2]);
+    ASSERT_EQ("\"[Gmail]/Sent \\\"Mail\\\"\"", Utils::QuoteString(mailBoxes[1]));
+}
+
+TEST(ListResponse, LocalFileNames)
+{
+    std::string mailBox = Utils::MailboxFileName("[Gmail]/Sent Mail");
+    ASSERT_EQ("_Gmail__Sent_Mail", mailBox);
+    std::string fileName = "42_" + mailBox + "_imap.server_Subject.eml";
+    ASSERT_EQ("42", Utils::ExtractLocalMessageUID(fileName, mailBox, "imap.server"));
+    ASSERT_EQ("", Utils::ExtractLocalMessageUID("42_INBOX_imap.server_Subject.eml", mailBox, "imap.server"));
+    ASSERT_EQ("", Utils::ExtractLocalMessageUID(".imap.server_INBOX_validity", "INBOX", "imap.server"));
+}
+
+TEST(Capabilities, ParseResponses)
+{
+    std::vector<std::string> capabilities =
+        Utils::ParseCapabilities("A1 OK [CAPABILITY IMAP4rev1 Compress=DEFLATE IDLE] Logged in\r\n");
+    ASSERT_EQ(3, capabilities.size());
+    ASSERT_EQ("COMPRESS=DEFLATE", capabilities[1]);
+    capabilities = Utils::ParseCapabilities("* CAPABILITY IMAP4rev1 CONDSTORE\r\nA2 OK done\r\n");
+    ASSERT_EQ(2, capabilities.size());
+    ASSERT_EQ("CONDSTORE", capabilities[1]);
+    ASSERT_TRUE(Utils::ParseCapabilities("A1 OK Logged in\r\n").empty());
+}
+
+TEST(Capabilities, ExistsResponse)
+{
+    ASSERT_TRUE(Utils::IsExistsResponse("* 23 EXISTS\r\n"));
+    ASSERT_TRUE(Utils::IsExistsResponse("* 1 exists\r\n"));
+    ASSERT_FALSE(Utils::IsExistsResponse("* 3 RECENT\r\n"));
+    ASSERT_FALSE(Utils::IsExistsResponse("* OK Still here\r\n"));
+}
+
+TEST(Capabilities, ModificationSequences)
+{
+    std::string response = "* 7 EXISTS\r\n* OK [UIDVALIDITY 42] UIDs valid\r\n* OK [HIGHESTMODSEQ 917] Highest\r\n"
+                           "* VANISHED (EARLIER) 3:5\r\n* 2 FETCH (UID 12 FLAGS (\\Seen) MODSEQ (900))\r\n"
+                           "* 7 FETCH (FLAGS () UID 20 MODSEQ (917))\r\nA3 OK [READ-WRITE] SELECT completed\r\n";
+    ASSERT_EQ(917, Utils::ParseHighestModSeq(response));
+    std::vector<std::string> messageUIDs = Utils::ParseFetchedUIDs(response);
+    ASSERT_EQ(2, messageUIDs.size());
+    ASSERT_EQ("12", messageUIDs[0]);
+    ASSERT_EQ("20", messageUIDs[1]);
+    ASSERT_EQ(0, Utils::ParseHighestModSeq("* OK [NOMODSEQ] No permanent modsequences\r\n"));
+}
+
+TEST(DeflateStream, RoundTrip)
+{
+    DeflateStream client;
+    DeflateStream server;
+    ASSERT_TRUE(client.IsInitialized());
+    std::string message = "* 1 FETCH (UID 1 BODY[] {30}\r\n";
+    for (int i = 0; i < 100; i++)
+        message += "Subject: repeated line " + std::to_string(i % 10) + "\r\n";
+    std::string compressed;
+    ASSERT_TRUE(client.Deflate(message.data(), message.length(), compressed));
+    ASSERT_LT(compressed.length(), message.length());
+    // Inflating in small chunks, so part of the output stays pending in the stream between calls
+    server.SetInput(compressed.data(), compressed.length());
+    std::string inflated;
+    char chunk[64];
+    long length;
+    while ((length = server.Inflate(chunk, sizeof(chunk))) > 0)
+        inflated.append(chunk, length);
+    ASSERT_EQ(0, length);
+    ASSERT_FALSE(server.HasPending());
+    ASSERT_EQ(message, inflated);
+}
+
+TEST(FetchQueue, StealsFromLongestQueue)
+{
+    FetchQueue queue(2);
+    for (uint32_t messageUID = 1; messageUID <= 5; messageUID++)
+        queue.Push({UIDSet(std::vector<uint32_t>{messageUID}), FETCH_BODY, "", false});
+    FetchCommand command;
+    // Worker 0 got UIDs 1, 3, 5 and worker 1 got UIDs 2, 4
+    ASSERT_TRUE(queue.Pop(1, command));
+    ASSERT_EQ("2", command.MessageUIDs.ToSequenceSet());
+    ASSERT_TRUE(queue.Pop(1, command));
+    ASSERT_EQ("4", command.MessageUIDs.ToSequenceSet());
+    ASSERT_TRUE(queue.Pop(1, command));
+    ASSERT_EQ("5", command.MessageUIDs.ToSequenceSet());
+    ASSERT_TRUE(queue.Pop(0, command));
+    ASSERT_EQ("1", command.MessageUIDs.ToSequenceSet());
+    ASSERT_TRUE(queue.Pop(0, command));
+    ASSERT_EQ("3", command.MessageUIDs.ToSequenceSet());
+    ASSERT_FALSE(queue.Pop(1, command));
+}
+
+TEST(SocketWaiter, WaitsWithDeadline)
+{
+    int sockets[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets));
+    SocketWaiter waiter;
+    ASSERT_TRUE(waiter.Watch(sockets[0]));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    ASSERT_EQ(SocketWaiter::WAIT_TIMED_OUT, waiter.Wait(false, deadline));
+    ASSERT_EQ(SocketWaiter::WAIT_READY, waiter.Wait(true, deadline + std::chrono::seconds(1)));
+    ASSERT_EQ(1, write(sockets[1], "*", 1));
+    ASSERT_EQ(SocketWaiter::WAIT_READY, waiter.Wait(false, deadline + std::chrono::seconds(1)));
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST(ConnectionRace, InterleavesFamilies)
+{
+    struct addrinfo addresses[5] = {};
+    int families[5] = {AF_INET6, AF_INET6, AF_INET6, AF_INET, AF_INET};
+    for (int i = 0; i < 5; i++)
+    {
+        addresses[i].ai_family = families[i];
+        addresses[i].ai_next = i < 4 ? &addresses[i + 1] : nullptr;
+    }
+    std::vector<const struct addrinfo *> ordered = ConnectionRace::InterleaveFamilies(addresses);
+    ASSERT_EQ(5, ordered.size());
+    ASSERT_EQ(&addresses[0], ordered[0]);
+    ASSERT_EQ(&addresses[3], ordered[1]);
+    ASSERT_EQ(&addresses[1], ordered[2]);
+    ASSERT_EQ(&addresses[4], ordered[3]);
+    ASSERT_EQ(&addresses[2], ordered[4]);
+}
+
+TEST(ConnectionRace, SkipsRefusedAddress)
+{
+    // Port of a closed socket refuses connections, the listening one behind it has to win
+    struct sockaddr_in endpoints[2] = {};
+    int sockets[2];
+    for (int i = 0; i < 2; i++)
+    {
+        socklen_t length = sizeof(endpoints[i]);
+        endpoints[i].sin_family = AF_INET;
+        endpoints[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_LE(0, sockets[i] = socket(AF_INET, SOCK_STREAM, 0));
+        ASSERT_EQ(0, bind(sockets[i], (struct sockaddr *)&endpoints[i], sizeof(endpoints[i])));
+        ASSERT_EQ(0, getsockname(sockets[i], (struct sockaddr *)&endpoints[i], &length));
+    }
+    close(sockets[0]);
+    ASSERT_EQ(0, listen(sockets[1], 1));
+    struct addrinfo addresses[2] = {};
+    for (int i = 0; i < 2; i++)
+    {
+        addresses[i].ai_family = AF_INET;
+        addresses[i].ai_socktype = SOCK_STREAM;
+        addresses[i].ai_addr = (struct sockaddr *)&endpoints[i];
+        addresses[i].ai_addrlen = sizeof(endpoints[i]);
+    }
+    addresses[0].ai_next = &addresses[1];
+    ConnectionRace race(addresses);
+    int connected = race.Connect(std::chrono::milliseconds(CONNECTION_ATTEMPT_DELAY),
+                                 std::chrono::steady_clock::now() + std::chrono::seconds(5));
+    ASSERT_LE(0, connected);
+    struct sockaddr_in peer = {};
+    socklen_t length = sizeof(peer);
+    ASSERT_EQ(0, getpeername(connected, (struct sockaddr *)&peer, &length));
+    ASSERT_EQ(endpoints[1].sin_port, peer.sin_port);
+    close(connected);
+    close(sockets[1]);
+}
+
+TEST(StreamedMessage, SplicedBetweenWrites)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_streamed_message";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    int splicePipe[2];
+    ASSERT_EQ(0, pipe(splicePipe));
+    {
+        StreamedMessage message("7", (directory / ".7.part").string(), 0);
+        ASSERT_TRUE(message.Write("Subject: Test\r\n", 15));
+        ASSERT_EQ(18, write(splicePipe[1], "From: a@example.sk", 18));
+        ASSERT_TRUE(message.Splice(splicePipe[0], 18));
+        ASSERT_TRUE(message.Write("\r\n\r\nbody\r\n", 10));
+        message.ParseFileName("example.server", "INBOX");
+        MessageStore store(directory.string());
+        ASSERT_TRUE(message.DumpToFile(store));
+    }
+    close(splicePipe[0]);
+    close(splicePipe[1]);
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+        files.push_back(entry.path());
+    ASSERT_EQ(1, files.size());
+    std::ifstream file(files[0], std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_EQ("Subject: Test\r\nFrom: a@example.sk\r\n\r\nbody\r\n", content);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(StreamedMessage, ResumesInterruptedDownload)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_resumed_message";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    std::string partialFile = (directory / ".9.part").string();
+    {
+        // Interrupted download keeps what was received
+        StreamedMessage message("9", partialFile, 0, true);
+        ASSERT_EQ(0, message.GetStoredLength());
+        ASSERT_TRUE(message.Write("Subject: Resumed\r\n", 18));
+        ASSERT_TRUE(message.Flush());
+    }
+    ASSERT_TRUE(std::filesystem::exists(partialFile));
+    {
+        StreamedMessage message("9", partialFile, 0, true);
+        ASSERT_EQ(18, message.GetStoredLength());
+        ASSERT_TRUE(message.Write("\r\nbody\r\n", 8));
+        message.ParseFileName("example.server", "INBOX");
+        MessageStore store(directory.string());
+        ASSERT_TRUE(message.DumpToFile(store));
+    }
+    ASSERT_FALSE(std::filesystem::exists(partialFile));
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+        files.push_back(entry.path());
+    ASSERT_EQ(1, files.size());
+    std::ifstream file(files[0], std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_EQ("Subject: Resumed\r\n\r\nbody\r\n", content);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(LocalIndex, RecordsStoredMessages)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_local_index";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    std::string indexFile = (directory / ".example.server_INBOX_index").string();
+    {
+        // Missing index has to be rebuilt
+        LocalIndex index(indexFile);
+        ASSERT_FALSE(index.Load("101"));
+        ASSERT_TRUE(index.Rebuild("101", UIDSet(std::vector<uint32_t>{1}), UIDSet()));
+        ASSERT_TRUE(index.Add(2, LocalIndex::STORED_HEADERS));
+        ASSERT_TRUE(index.Add(2, LocalIndex::STORED_MESSAGE));
+        ASSERT_TRUE(index.Add(3, LocalIndex::STORED_HEADERS));
+    }
+    {
+        // Torn record is dropped
+        std::ofstream file(indexFile, std::ios::app);
+        file << "F 4";
+    }
+    LocalIndex index(indexFile);
+    ASSERT_TRUE(index.Load("101"));
+    ASSERT_EQ("1:2", index.GetMessages().ToSequenceSet());
+    ASSERT_EQ("3", index.GetHeaders().ToSequenceSet());
+    // Compacted index holds ranges
+    ASSERT_TRUE(index.Load("101"));
+    ASSERT_EQ("1:2", index.GetMessages().ToSequenceSet());
+    ASSERT_EQ("3", index.GetHeaders().ToSequenceSet());
+    // Index of another UIDValidity or a corrupt one is not used
+    ASSERT_FALSE(index.Load("102"));
+    {
+        std::ofstream file(indexFile, std::ios::app);
+        file << "X 5\n";
+    }
+    ASSERT_FALSE(index.Load("101"));
+    std::filesystem::remove_all(directory);
+}
+
+TEST(UIDSet, CompressesRuns)
+{
+    UIDSet uids(std::vector<std::string>{"7", "1", "2", "3", "5", "8", "3"});
+    ASSERT_EQ("1:3,5,7:8", uids.ToSequenceSet());
+    ASSERT_EQ(6, uids.Size());
+    ASSERT_EQ(8, uids.Highest());
+    ASSERT_TRUE(uids.Contains(2));
+    ASSERT_FALSE(uids.Contains(4));
+    ASSERT_FALSE(uids.Contains(9));
+    uids.Insert(4);
+    uids.Insert(6);
+    ASSERT_EQ("1:8", uids.ToSequenceSet());
+    uids.Erase(5);
+    uids.Erase(1);
+    ASSERT_EQ("2:4,6:8", uids.ToSequenceSet());
+    uids.Insert(20, 30);
+    uids.Insert(10, 21);
+    ASSERT_EQ("2:4,6:8,10:30", uids.ToSequenceSet());
+    ASSERT_EQ("2:4", UIDSet(std::vector<uint32_t>{4, 2, 3}).ToSequenceSet());
+    UIDSet empty;
+    ASSERT_TRUE(empty.Empty());
+    ASSERT_EQ(0, empty.Highest());
+    // Numbers that are not UIDs are skipped instead of being truncated
+    uint32_t uid = 0;
+    ASSERT_TRUE(UIDSet::ParseUID("4294967295", uid));
+    ASSERT_EQ(UINT32_MAX, uid);
+    ASSERT_FALSE(UIDSet::ParseUID("4294967296", uid));
+    ASSERT_FALSE(UIDSet::ParseUID("123456789012345678901234567890", uid));
+    ASSERT_FALSE(UIDSet::ParseUID("", uid));
+    ASSERT_EQ("1,4294967295",
+              UIDSet(std::vector<std::string>{"1", "4294967296", "99999999999999999999999", "4294967295"})
+                  .ToSequenceSet());
+}
+
+TEST(UIDSet, UnionAndDifference)
+{
+    UIDSet remote;
+    remote.Insert(1, 1000000);
+    UIDSet local;
+    local.Insert(1, 499999);
+    local.Insert(500001, 999990);
+    local.Insert(2000000);
+    ASSERT_EQ("500000,999991:1000000", remote.Difference(local).ToSequenceSet());
+    ASSERT_EQ(11, remote.Difference(local).Size());
+    ASSERT_EQ("2000000", local.Difference(remote).ToSequenceSet());
+    ASSERT_TRUE(remote.Difference(remote).Empty());
+    ASSERT_EQ("1:1000000,2000000", remote.Union(local).ToSequenceSet());
+    ASSERT_EQ(remote, local.Union(remote).Difference(UIDSet(std::vector<uint32_t>{2000000})));
+    UIDSet highest;
+    highest.Insert(UINT32_MAX - 1, UINT32_MAX);
+    ASSERT_EQ("4294967294:4294967295", highest.Union(UIDSet(std::vector<uint32_t>{UINT32_MAX})).ToSequenceSet());
+    ASSERT_EQ("4294967294", highest.Difference(UIDSet(std::vector<uint32_t>{UINT32_MAX})).ToSequenceSet());
+}
+
+TEST(MessageStore, MaildirDelivery)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_maildir";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    std::unique_ptr<MessageStore> store = MessageStore::Create(Utils::STORE_MAILDIR, directory.string());
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store->Prepare());
+    std::string temporaryFilePath = store->TemporaryFilePath("7_INBOX_example.server");
+    ASSERT_EQ((directory / "tmp" / "7_INBOX_example.server.part").string(), temporaryFilePath);
+    {
+        std::ofstream file(temporaryFilePath);
+        file << "Subject: Test\r\n\r\n";
+    }
+    ASSERT_TRUE(store->Deliver(temporaryFilePath, "7_INBOX_example.server_Test_a@example.sk_1_h.eml", true));
+    ASSERT_FALSE(std::filesystem::exists(temporaryFilePath));
+    std::vector<std::filesystem::path> files = store->ListMessageFiles();
+    ASSERT_EQ(1, files.size());
+    ASSERT_EQ(directory / "cur" / "7_INBOX_example.server_Test_a@example.sk_1:2,h", files[0]);
+    ASSERT_TRUE(store->IsHeadersOnly(files[0].filename()));
+    ASSERT_FALSE(store->IsHeadersOnly("7_INBOX_example.server_Test_a@example.sk_1:2,S"));
+    ASSERT_EQ("7", Utils::ExtractLocalMessageUID(files[0].filename(), "INBOX", "example.server"));
+    // Colons and slashes of the subject are not taken for the info or a directory
+    ASSERT_TRUE(store->Write("Subject: Re: a/b\r\n\r\n", "8_INBOX_example.server_Re:_a/b_a@example.sk_1.eml", false));
+    ASSERT_TRUE(std::filesystem::exists(directory / "cur" / "8_INBOX_example.server_Re__a_b_a@example.sk_1:2,"));
+    store->Remove(directory / "cur" / "8_INBOX_example.server_Re__a_b_a@example.sk_1:2,");
+    // Flat store tells headers by the file name
+    MessageStore flatStore(directory.string());
+    ASSERT_TRUE(flatStore.IsHeadersOnly("7_INBOX_example.server_Test_a@example.sk_1_h.eml"));
+    ASSERT_FALSE(flatStore.IsHeadersOnly("7_INBOX_example.server_Test_a@example.sk_1.eml"));
+    std::filesystem::remove_all(directory);
+}
+
+TEST(MessageStore, ShardedDelivery)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_sharded";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    std::unique_ptr<MessageStore> store = MessageStore::Create(Utils::STORE_SHARDED, directory.string());
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store->Prepare());
+    ASSERT_TRUE(std::filesystem::is_directory(directory / "ff"));
+    // Headers and the full message of a UID share the shard
+    std::string headersName = "7_INBOX_example.server_Test_a@example.sk_1_h.eml";
+    std::string messageName = "7_INBOX_example.server_Test_a@example.sk_1.eml";
+    std::string shard = ShardedStore::ShardOf(headersName);
+    ASSERT_EQ(2, shard.length());
+    ASSERT_EQ(shard, ShardedStore::ShardOf(messageName));
+    ASSERT_TRUE(store->Write("Subject: Test\r\n\r\n", headersName, true));
+    ASSERT_TRUE(std::filesystem::exists(directory / shard / headersName));
+    std::vector<std::filesystem::path> files = store->ListMessageFiles();
+    ASSERT_EQ(1, files.size());
+    ASSERT_TRUE(store->IsHeadersOnly(files[0].filename()));
+    store->Remove(files[0]);
+    ASSERT_TRUE(store->ListMessageFiles().empty());
+    std::filesystem::remove_all(directory);
+}
+
+TEST(MessageStore, DedupLinks)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_dedup";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    std::unique_ptr<MessageStore> store = MessageStore::Create(Utils::STORE_DEDUP, directory.string());
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store->Prepare());
+    std::istringstream empty("");
+    ASSERT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", DedupStore::Digest(empty));
+    // Same body fetched from two mailboxes is stored once
+    std::string body = "Subject: Test\r\n\r\nbody\r\n";
+    ASSERT_TRUE(store->Write(body, "7_INBOX_example.server_Test_a@example.sk_1.eml", false));
+    std::string temporaryFilePath = store->TemporaryFilePath("3_Archive_example.server");
+    {
+        std::ofstream file(temporaryFilePath, std::ios::binary);
+        file << body;
+    }
+    ASSERT_TRUE(store->Deliver(temporaryFilePath, "3_Archive_example.server_Test_a@example.sk_1.eml", false));
+    ASSERT_FALSE(std::filesystem::exists(temporaryFilePath));
+    std::filesystem::path inbox = directory / "7_INBOX_example.server_Test_a@example.sk_1.eml";
+    std::filesystem::path archive = directory / "3_Archive_example.server_Test_a@example.sk_1.eml";
+    ASSERT_EQ(3, std::filesystem::hard_link_count(inbox));
+    ASSERT_TRUE(std::filesystem::equivalent(inbox, archive));
+    // Object goes away with its last message
+    store->Remove(inbox);
+    ASSERT_EQ(2, std::filesystem::hard_link_count(archive));
+    store->Remove(archive);
+    std::size_t objects = 0;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(directory / "objects"))
+        objects += entry.is_regular_file();
+    ASSERT_EQ(0, objects);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(MessageStore, ArchiveSegments)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_archive";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    {
+        // Segments are tiny, so every message but the first one starts a new segment
+        ArchiveStore store(directory.string(), 16);
+        ASSERT_EQ(Utils::IMAPCL_SUCCESS, store.Prepare());
+        ASSERT_TRUE(store.Write("Subject: One\r\n\r\n", "1_INBOX_example.server_One_a@example.sk_1_h.eml", true));
+        ASSERT_TRUE(store.Write("Subject: One\r\n\r\nbody\r\n", "1_INBOX_example.server_One_a@example.sk_1.eml",
+                                false));
+        std::string temporaryFilePath = store.TemporaryFilePath("2_INBOX_example.server");
+        {
+            std::ofstream file(temporaryFilePath);
+            file << "Subject: Two\r\n\r\n";
+        }
+        ASSERT_TRUE(store.Deliver(temporaryFilePath, "2_INBOX_example.server_Two_a@example.sk_2.eml", false));
+        ASSERT_FALSE(std::filesystem::exists(temporaryFilePath));
+        ASSERT_TRUE(store.Write("Subject: Three\r\n\r\n", "3_INBOX_example.server_Three\tx_a@example.sk_3.eml", false));
+        {
+            // Received body is written in place of the segment, a given up one leaves no trace
+            StreamedMessage discarded("4", store, store.TemporaryFilePath("4_INBOX_example.server"), 17);
+            ASSERT_TRUE(discarded.Write("Subject: Four\r\n", 15));
+        }
+        StreamedMessage message("4", store, store.TemporaryFilePath("4_INBOX_example.server"), 17);
+        ASSERT_TRUE(message.Write("Subject: Four\r\n\r\n", 17));
+        message.ParseFileName("example.server", "INBOX");
+        ASSERT_TRUE(message.DumpToFile(store));
+        ASSERT_EQ(17, std::filesystem::file_size(directory / "archive" / "segment-000005"));
+        ASSERT_FALSE(std::filesystem::exists(store.TemporaryFilePath("4_INBOX_example.server")));
+        store.Remove(directory / "3_INBOX_example.server_Three\tx_a@example.sk_3.eml");
+        // Pending records are listed before they are flushed
+        ASSERT_EQ(4, store.ListMessageFiles().size());
+        ASSERT_FALSE(std::filesystem::exists(directory / "archive" / "index") &&
+                     std::filesystem::file_size(directory / "archive" / "index"));
+        store.Remove(directory / "1_INBOX_example.server_One_a@example.sk_1_h.eml");
+        ASSERT_TRUE(store.Flush());
+    }
+    ASSERT_FALSE(std::filesystem::exists(directory / "archive" / "segment-000006"));
+    ArchiveStore store(directory.string());
+    std::vector<std::filesystem::path> files = store.ListMessageFiles();
+    ASSERT_EQ(3, files.size());
+    ASSERT_EQ(directory / "1_INBOX_example.server_One_a@example.sk_1.eml", files[0]);
+
+    std::filesystem::path extracted = directory / "extracted";
+    std::filesystem::create_directory(extracted);
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store.Extract({"2"}, extracted.string()));
+    std::ifstream file(extracted / "2_INBOX_example.server_Two_a@example.sk_2.eml", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_EQ("Subject: Two\r\n\r\n", content);
+    ASSERT_EQ(Utils::ARCHIVE_NOT_FOUND, store.Extract({"3"}, extracted.string()));
+    std::filesystem::path streamedDirectory = directory / "streamed";
+    std::filesystem::create_directory(streamedDirectory);
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store.Extract({"4"}, streamedDirectory.string()));
+    std::ifstream streamed(std::filesystem::directory_iterator(streamedDirectory)->path(), std::ios::binary);
+    std::string streamedContent((std::istreambuf_iterator<char>(streamed)), std::istreambuf_iterator<char>());
+    ASSERT_EQ("Subject: Four\r\n\r\n", streamedContent);
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store.Extract({}, extracted.string()));
+    ASSERT_EQ(3, std::distance(std::filesystem::directory_iterator(extracted), std::filesystem::directory_iterator()));
+    std::filesystem::remove_all(directory);
+}
+
+TEST(MessageStore, ArchiveExtractsUIDOfOneMailbox)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "imapcl_archive_mailboxes";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "extracted");
+    {
+        ArchiveStore store(directory.string());
+        ASSERT_EQ(Utils::IMAPCL_SUCCESS, store.Prepare());
+        ASSERT_TRUE(store.Write("Subject: Inbox\r\n\r\n", "3_INBOX_example.server_Inbox_a@example.sk_1.eml", false));
+        ASSERT_TRUE(store.Write("Subject: Sent\r\n\r\n", "3_Sent_example.server_Sent_a@example.sk_2.eml", false));
+        ASSERT_TRUE(store.Write("Subject: Sent\r\n\r\n", "3_Sent_example.server_Sent_a@example.sk_2_h.eml", true));
+    }
+    ArchiveStore store(directory.string());
+    std::string extracted = (directory / "extracted").string();
+    // Bare UID is found in both mailboxes, nothing is written
+    ASSERT_EQ(Utils::ARCHIVE_AMBIGUOUS_NAME, store.Extract({"3"}, extracted));
+    ASSERT_TRUE(std::filesystem::is_empty(extracted));
+    // Full message and headers of the same message are not ambiguous
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store.Extract({"3_Sent"}, extracted));
+    ASSERT_EQ(2, std::distance(std::filesystem::directory_iterator(extracted), std::filesystem::directory_iterator()));
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, store.Extract({"3_INBOX_example.server"}, extracted));
+    ASSERT_TRUE(std::filesystem::exists(directory / "extracted" / "3_INBOX_example.server_Inbox_a@example.sk_1.eml"));
+    std::filesystem::remove_all(directory);
+}
+
+TEST(SecureContextFactory, SharesContexts)
+{
+    SSL_CTX *firstContext = nullptr;
+    SSL_CTX *secondContext = nullptr;
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, SecureContextFactory::Acquire("", "/etc/ssl/certs/", firstContext));
+    ASSERT_EQ(Utils::IMAPCL_SUCCESS, SecureContextFactory::Acquire("", "/etc/ssl/certs/", secondContext));
+    ASSERT_EQ(firstContext, secondContext);
+    SSL_CTX_free(firstContext);
+    SSL_CTX_free(secondContext);
+    SSL_CTX *invalidContext = nullptr;
+    ASSERT_EQ(Utils::CERTIFICATE_ERROR,
+              SecureContextFactory::Acquire("./tests/resources/nonexistent.pem", "/etc/ssl/certs/", invalidContext));
+    ASSERT_EQ(nullptr, invalidContext);
+}
+
 int main()
 {
     testing::InitGoogleTest();